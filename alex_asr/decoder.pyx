@@ -15,53 +15,326 @@ cimport alex_asr.fst.libfst
 from alex_asr.utils import lattice_to_nbest
 
 
+cdef extern from "src/lattice_faster_online_decoder.h" namespace "alex_asr":
+    cdef cppclass DecoderPoolStats:
+        long long tokens_used
+        long long tokens_allocated
+        long long links_used
+        long long links_allocated
+        long long bytes
+
+
+cdef extern from "src/decoder_listener.h" namespace "alex_asr":
+    cdef cppclass DecoderEvent:
+        int type
+        vector[int] words
+        vector[int] times
+        vector[int] lengths
+
+    cdef cppclass _DecoderEventQueue "alex_asr::DecoderEventQueue":
+        _DecoderEventQueue() except +
+        void PopAll(vector[DecoderEvent] *events_out) except +
+
+DEF EVENT_PARTIAL_RESULT = 0
+DEF EVENT_STABLE_PREFIX = 1
+DEF EVENT_ENDPOINT = 2
+DEF EVENT_COMMIT = 3
+DEF EVENT_SEGMENT = 4
+DEF EVENT_KEYWORD = 5
+
+
+cdef extern from "src/decoder_model.h" namespace "alex_asr":
+    cdef cppclass _ModelManager "alex_asr::ModelManager":
+        _ModelManager(string model_path) except +
+        bool Reload(string model_path) except +
+        bool Reloading() except +
+        bool WaitForReload(string *error) nogil except +
+
+
+cdef extern from "src/final_result.h" namespace "alex_asr":
+    cdef cppclass _FinalResult "alex_asr::FinalResult":
+        void Unref()
+        bool Ready() except +
+        void Wait() nogil except +
+        bool GetBestPath(vector[int] *v_out, float *lik) except +
+        bool GetLattice(alex_asr.fst.libfst.LogVectorFst *fst_out, double *tot_lik) except +
+        bool GetTimeAlignment(vector[int] *words, vector[int] *times, vector[int] *durations) except +
+        bool GetTimeAlignmentWithWordConfidence(vector[int] *words, vector[int] *times, vector[int] *durations, vector[float] *confs) except +
+        int NumFramesDecoded() except +
+
+
 cdef extern from "src/decoder.h" namespace "alex_asr":
+    cdef cppclass SessionBudgetStatus:
+        bool beam_tightened
+        bool best_path_only
+        bool endpoint_forced
+
     cdef cppclass _Decoder "alex_asr::Decoder":
         _Decoder(string model_path) except +
+        _Decoder(_ModelManager *manager) except +
         size_t Decode(int max_frames) except +
         void FrameIn(unsigned char *frame, size_t frame_len) except +
-        bool GetBestPath(vector[int] *v_out, float *lik) except +
-        bool GetLattice(alex_asr.fst.libfst.LogVectorFst *fst_out, double *tot_lik) except +
-        bool GetTimeAlignment(vector[int] *words, vector[int] *times, vector[int] *durations) except +
-        bool GetTimeAlignmentWithWordConfidence(vector[int] *words, vector[int] *times, vector[int] *durations, vector[float] *confs) except +
+        bool GetBestPath(vector[int] *v_out, float *lik, int graph) except +
+        bool GetLattice(alex_asr.fst.libfst.LogVectorFst *fst_out, double *tot_lik, bool end_of_utt, int graph) except +
+        bool GetLatticeBuffer(vector[char] *buffer, bool with_alignments, bool end_of_utt, int graph) except +
+        bool GetTimeAlignment(vector[int] *words, vector[int] *times, vector[int] *durations, int graph) except +
+        void GetCommittedResult(vector[int] *words, vector[int] *times, vector[int] *durations) except +
+        bool GetTimeAlignmentWithWordConfidence(vector[int] *words, vector[int] *times, vector[int] *durations, vector[float] *confs, int graph) except +
+        bool GetConfusionNetwork(vector[vector[int]] *words, vector[vector[float]] *posteriors, vector[float] *begin_times, vector[float] *end_times, int graph) except +
         string GetWord(int word_id) except +
+        vector[string] GetGraphNames() except +
         void InputFinished() except +
         bool EndpointDetected() except +
         void FinalizeDecoding() except +
-        void Reset() except +
-        float FinalRelativeCost() except +
+        void Reset(bool keep_adaptation) except +
+        _FinalResult *FinalizeDecodingAsync(bool keep_adaptation) except +
+        void GetAdaptationState(string *state_out) except +
+        void SetAdaptationState(string state_in) except +
+        void Checkpoint(string *checkpoint_out) except +
+        void Restore(string checkpoint_in) except +
+        float FinalRelativeCost(int graph) except +
         int NumFramesDecoded() except +
+        bool KeywordGated() except +
         int TrailingSilenceLength() except +
+        void GetPoolStats(DecoderPoolStats *stats) except +
+        void GetBudgetStatus(SessionBudgetStatus *status) except +
+        void SetListener(_DecoderEventQueue *listener) except +
         void GetIvector(vector[float] *ivector) except +
         int GetBitsPerSample() except +
         void SetBitsPerSample(int n_bits) except +
+        void SetInputSamplingFrequency(int samp_freq) except +
+        int GetInputSamplingFrequency() except +
         float GetFrameShift() except +
+        void SetClassPhrases(string class_name, vector[string] phrases, vector[float] costs) except +
+        void ClearClasses() except +
         void SetSpkrID(string spkr_ID) except +
         string GetSpkrID() except +
         vector[string] GetSpkrList() except +
 
 
 
+cdef class LatticeBuffer:
+    """Lattice serialized into one contiguous block of memory.
+
+    Supports the buffer protocol, so it can be wrapped without copying by `memoryview` or
+    `numpy.frombuffer`, or written to a socket directly. The layout is described in `src/utils.h`
+    and can be unpacked by `alex_asr.utils.flat_lattice_arrays`.
+    """
+
+    cdef vector[char] data
+    cdef Py_ssize_t shape[1]
+    cdef Py_ssize_t strides[1]
+
+    def __len__(self):
+        return self.data.size()
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        self.shape[0] = self.data.size()
+        self.strides[0] = 1
+
+        buffer.buf = <char *> &self.data[0] if self.data.size() > 0 else NULL
+        buffer.format = 'B'
+        buffer.internal = NULL
+        buffer.itemsize = 1
+        buffer.len = self.data.size()
+        buffer.ndim = 1
+        buffer.obj = self
+        buffer.readonly = 1
+        buffer.shape = self.shape
+        buffer.strides = self.strides
+        buffer.suboffsets = NULL
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+
 # NOTE: Function signatures as the first line of the docstring are needed in order for
 # sphinx to generate nice documentation.
+cdef class ModelManager:
+    """Speech recognition models shared by several decoders and replaceable while they run."""
+
+    cdef _ModelManager * thisptr
+
+    def __init__(self, model_path):
+        """__init__(self, model_path)
+        Load the initial models.
+
+        Args:
+            model_path (str): Path where the speech recognition models are stored.
+        """
+        self.thisptr = new _ModelManager(model_path.encode('utf8'))
+
+    def __dealloc__(self):
+        del self.thisptr
+
+    def reload(self, model_path):
+        """reload(self, model_path)
+        Start loading new models in the background.
+
+        Decoders created from this manager switch to the new models at their next `reset`; utterances
+        in progress finish with the models they started with. If loading fails, the old models stay in use.
+
+        Args:
+            model_path (str): Path where the new speech recognition models are stored.
+
+        Returns:
+            False if another reload is still running.
+        """
+        return self.thisptr.Reload(model_path.encode('utf8'))
+
+    def is_reloading(self):
+        """is_reloading(self)
+        Returns:
+            True while new models are being loaded.
+        """
+        return self.thisptr.Reloading()
+
+    def wait_for_reload(self):
+        """wait_for_reload(self)
+        Wait until the last reload finishes.
+
+        Raises:
+            RuntimeError: If loading the new models failed.
+        """
+        cdef string error
+        cdef bool ok
+        with nogil:
+            ok = self.thisptr.WaitForReload(&error)
+        if not ok:
+            raise RuntimeError(error.decode('utf8'))
+
+
+cdef class FinalResult:
+    """Final result of an utterance handed over by `Decoder.finalize_decoding_async`.
+
+    The result is computed on a worker thread of the decoder; the getters wait for it (without holding
+    the GIL) and return what the getters of the decoder would have returned for the main graph after
+    `finalize_decoding`.
+    """
+
+    cdef _FinalResult * thisptr
+    cdef float frame_shift
+
+    def __dealloc__(self):
+        if self.thisptr != NULL:
+            self.thisptr.Unref()
+
+    def ready(self):
+        """ready(self)
+        Returns:
+            True if the result has been computed.
+        """
+        return self.thisptr.Ready()
+
+    def wait(self):
+        """wait(self)
+        Wait until the result has been computed."""
+        with nogil:
+            self.thisptr.Wait()
+
+    def get_best_path(self):
+        """get_best_path(self)
+        Get the 1-best hypothesis of the utterance.
+
+        Returns:
+            tuple: (likelihood, list of word id's)
+        """
+        cdef vector[int] t
+        cdef float lik
+        self.wait()
+        self.thisptr.GetBestPath(address(t), address(lik))
+        words = [t[i] for i in xrange(t.size())]
+        return (lik, words)
+
+    def get_nbest(self, n=1):
+        """get_nbest(self, n=1)
+        Get n best hypotheses of the utterance (from word posterior lattice).
+
+        Returns:
+            list of hypotheses; each hypothesis is a tuple (hypothesis probability, list of word ids)
+        """
+        lik, lat = self.get_lattice()
+        return lattice_to_nbest(lat, n)
+
+    def get_lattice(self):
+        """get_lattice(self)
+        Get the word posterior lattice of the utterance and its likelihood.
+
+        Returns:
+            tuple: (lattice likelihood, lattice)
+        """
+        cdef double lik = -1
+        r = alex_asr.fst.LogVectorFst()
+        self.wait()
+        if self.thisptr.NumFramesDecoded() > 0:
+            self.thisptr.GetLattice((<alex_asr.fst._fst.LogVectorFst?>r).fst, address(lik))
+        return (lik, r)
+
+    def get_time_alignment(self):
+        """get_time_alignment(self)
+        Get time alignment of the 1-best hypothesis of the utterance.
+
+        Returns:
+            tuple: (list of word id's, list of start times, list of durations)
+        """
+        cdef vector[int] w
+        cdef vector[int] t
+        cdef vector[int] d
+        self.wait()
+        self.thisptr.GetTimeAlignment(address(w), address(t), address(d))
+        words = [w[i] for i in xrange(w.size()) if w[i] != 0]
+        times = [t[i] * self.frame_shift for i in xrange(t.size()) if w[i] != 0]
+        durations = [d[i] * self.frame_shift for i in xrange(d.size()) if w[i] != 0]
+
+        return (words, times, durations)
+
+    def get_time_alignment_with_word_confidence(self):
+        """get_time_alignment_with_word_confidence(self)
+        Get time alignment of the 1-best hypothesis of the utterance with word confidences.
+
+        Returns:
+            tuple: (list of word id's, list of start times, list of durations, list of confidences)
+        """
+        cdef vector[int] w
+        cdef vector[int] t
+        cdef vector[int] d
+        cdef vector[float] c
+        self.wait()
+        self.thisptr.GetTimeAlignmentWithWordConfidence(address(w), address(t), address(d), address(c))
+        words = [w[i] for i in xrange(w.size()) if w[i] != 0]
+        times = [t[i] * self.frame_shift for i in xrange(t.size()) if w[i] != 0]
+        durations = [d[i] * self.frame_shift for i in xrange(d.size()) if w[i] != 0]
+
+        return (words, times, durations, c)
+
+
 cdef class Decoder:
     """Speech recognition decoder."""
 
     cdef _Decoder * thisptr
+    cdef ModelManager manager
+    cdef _DecoderEventQueue * events
+    cdef object listener
     cdef utt_decoded
 
-    def __init__(self, model_path):
-        """__init__(self, model_path)
+    def __init__(self, model):
+        """__init__(self, model)
         Initialise recognizer with audio input stream parameters.
 
         Args:
-            model_path (str): Path where the speech recognition models are stored.
+            model (str or ModelManager): Path where the speech recognition models are stored, or a
+                ModelManager whose models the decoder shares and follows on reload.
         """
-        self.thisptr = new _Decoder(model_path.encode('utf8'))
+        if isinstance(model, ModelManager):
+            self.manager = model
+            self.thisptr = new _Decoder(self.manager.thisptr)
+        else:
+            self.thisptr = new _Decoder(model.encode('utf8'))
         self.utt_decoded = 0
 
     def __dealloc__(self):
         del self.thisptr
+        del self.events
 
     def decode(self, max_frames=10):
         """decode(self, max_frames=10)
@@ -75,8 +348,78 @@ cdef class Decoder:
         """
         new_dec = self.thisptr.Decode(max_frames)
         self.utt_decoded += new_dec
+        self._dispatch_events()
         return new_dec
 
+    def set_listener(self, listener):
+        """set_listener(self, listener)
+        Get the results pushed as they change instead of polling for them.
+
+        At the end of `decode` and `finalize_decoding`, the decoder calls these methods of the listener
+        (those the listener does not have are skipped):
+
+          - `on_partial_result(word_ids)`: the best hypothesis changed,
+          - `on_stable_prefix(word_ids)`: these first words of the hypothesis will not change any more
+            (after `finalize_decoding`, the whole hypothesis),
+          - `on_endpoint()`: an endpoint was detected; called once per utterance,
+          - `on_commit(word_ids, times, durations)`: in the long-audio mode (`--long_audio_commit_secs`),
+            these words with their start times and durations in seconds were committed; the hypotheses
+            passed afterwards start after them,
+          - `on_segment(word_ids, times, durations)`: with `--auto_segment`, the decoder finalized the
+            segment ending at an endpoint, and these are its words; decoding goes on with the next segment,
+          - `on_keyword(word_id)`: with `--keyword_graph`, this keyword was found and the main search
+            started; the hypotheses passed afterwards are those of the main search.
+
+        The changes are tracked inside the decoder, so nothing is computed when nothing changed.
+
+        Args:
+            listener: Object with the callbacks, or None to stop.
+        """
+        cdef vector[DecoderEvent] stale_events
+        if self.events != NULL:
+            self.events.PopAll(address(stale_events))
+        if listener is None:
+            self.thisptr.SetListener(NULL)
+        else:
+            if self.events == NULL:
+                self.events = new _DecoderEventQueue()
+            self.thisptr.SetListener(self.events)
+        self.listener = listener
+
+    def _dispatch_events(self):
+        cdef vector[DecoderEvent] events
+        if self.listener is None:
+            return
+        self.events.PopAll(address(events))
+        for i in xrange(events.size()):
+            words = [events[i].words[j] for j in xrange(events[i].words.size())]
+            if events[i].type == EVENT_PARTIAL_RESULT:
+                callback = getattr(self.listener, 'on_partial_result', None)
+                if callback is not None:
+                    callback(words)
+            elif events[i].type == EVENT_STABLE_PREFIX:
+                callback = getattr(self.listener, 'on_stable_prefix', None)
+                if callback is not None:
+                    callback(words)
+            elif events[i].type == EVENT_ENDPOINT:
+                callback = getattr(self.listener, 'on_endpoint', None)
+                if callback is not None:
+                    callback()
+            elif events[i].type == EVENT_COMMIT or events[i].type == EVENT_SEGMENT:
+                if events[i].type == EVENT_COMMIT:
+                    callback = getattr(self.listener, 'on_commit', None)
+                else:
+                    callback = getattr(self.listener, 'on_segment', None)
+                if callback is not None:
+                    frame_shift = self.thisptr.GetFrameShift()
+                    callback(words,
+                             [events[i].times[j] * frame_shift for j in xrange(events[i].times.size())],
+                             [events[i].lengths[j] * frame_shift for j in xrange(events[i].lengths.size())])
+            elif events[i].type == EVENT_KEYWORD:
+                callback = getattr(self.listener, 'on_keyword', None)
+                if callback is not None:
+                    callback(words[0])
+
     def accept_audio(self, bytes frame_str):
         """accept_audio(self, bytes frame_str)
         Insert given buffer of audio to the decoder for decoding.
@@ -90,37 +433,45 @@ cdef class Decoder:
         """
         self.thisptr.FrameIn(frame_str, len(frame_str))
 
-    def get_best_path(self):
-        """get_best_path(self)
+    def get_best_path(self, graph=0):
+        """get_best_path(self, graph=0)
         Get current 1-best decoding hypothesis.
 
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
         Returns:
             tuple: (hypothesis likelihood, list of word id's)
         """
         cdef vector[int] t
         cdef float lik
-        self.thisptr.GetBestPath(address(t), address(lik))
+        self.thisptr.GetBestPath(address(t), address(lik), graph)
         words = [t[i] for i in xrange(t.size())]
         return (lik, words)
 
-    def get_nbest(self, n=1):
-        """get_nbest(self, n=1)
+    def get_nbest(self, n=1, graph=0):
+        """get_nbest(self, n=1, graph=0)
         Get n best decoding hypotheses (from word posterior lattice).
 
         Args:
             n (int): How many hypotheses to generate.
+            graph (int): Index of the graph to read (see `get_graph_names`).
 
         Returns:
             list of hypotheses; each hypothesis is a tuple (hypothesis probability, list of word ids)
         """
-        lik, lat = self.get_lattice()
+        lik, lat = self.get_lattice(graph)
         return lattice_to_nbest(lat, n)
 
-    def get_lattice(self):
-        """get_lattice(self)
+    def get_lattice(self, graph=0):
+        """get_lattice(self, graph=0)
         Get word posterior lattice and its likelihood.
 
         NOTE: It may last 100 ms so consideration is needed when used in a timing-critical applications.
+        The time can be bounded by `--post_lattice_beam` and `--post_lattice_max_arcs` in the model configuration.
+
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
 
         Returns:
             tuple: (lattice likelihood, lattice)
@@ -128,15 +479,49 @@ cdef class Decoder:
         """
         cdef double lik = -1
         r = alex_asr.fst.LogVectorFst()
-        if self.utt_decoded > 0:
-            self.thisptr.GetLattice((<alex_asr.fst._fst.LogVectorFst?>r).fst, address(lik))
-        self.utt_decoded = 0
+        if self._lattice_ready(graph):
+            self.thisptr.GetLattice((<alex_asr.fst._fst.LogVectorFst?>r).fst, address(lik), True, graph)
         return (lik, r)
 
-    def get_time_alignment(self):
-        """get_best_path(self)
+    def _lattice_ready(self, graph):
+        # Reading the lattice of the main graph marks the utterance as read;
+        # the extra graphs only need some decoded frames (as does a segment
+        # just started by --auto_segment).
+        if graph == 0:
+            ready = self.utt_decoded > 0 and self.thisptr.NumFramesDecoded() > 0
+            self.utt_decoded = 0
+            return ready
+        return self.thisptr.NumFramesDecoded() > 0
+
+    def get_lattice_buffer(self, with_alignments=False, graph=0):
+        """get_lattice_buffer(self, with_alignments=False, graph=0)
+        Get the lattice as a flat binary buffer.
+
+        Unlike get_lattice, no Python objects are created per state or arc.
+
+        Args:
+            with_alignments (bool): If False, the buffer holds the word posterior lattice (as in
+                get_lattice). If True, it holds the determinized lattice with graph and acoustic
+                costs and transition-id alignments.
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
+        Returns:
+            LatticeBuffer
+        """
+        cdef LatticeBuffer buf = LatticeBuffer()
+        # Unlike get_lattice, this does not mark the utterance as read, so the buffer can be taken
+        # together with the other results.
+        if self.thisptr.NumFramesDecoded() > 0:
+            self.thisptr.GetLatticeBuffer(address(buf.data), with_alignments, True, graph)
+        return buf
+
+    def get_time_alignment(self, graph=0):
+        """get_time_alignment(self, graph=0)
         Get time alignment of the current 1-best decoding hypothesis.
 
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
         Returns:
             tuple: (list of word id's, list of start times, list of durations)
         """
@@ -145,17 +530,46 @@ cdef class Decoder:
         cdef vector[int] t
         cdef vector[int] d
         cdef float frame_shift = self.thisptr.GetFrameShift()
-        self.thisptr.GetTimeAlignment(address(w), address(t), address(d))
+        self.thisptr.GetTimeAlignment(address(w), address(t), address(d), graph)
         words = [w[i] for i in xrange(w.size()) if w[i] != 0]
         times = [t[i] * frame_shift for i in xrange(t.size()) if w[i] != 0]
         durations = [d[i] * frame_shift for i in xrange(d.size()) if w[i] != 0]
 
         return (words, times, durations)
 
-    def get_time_alignment_with_word_confidence(self):
-        """get_best_path(self)
+    def get_committed_result(self):
+        """get_committed_result(self)
+        Get the words committed in the long-audio mode (`--long_audio_commit_secs`) and the words of the
+        segments finalized with `--auto_segment` since the last call.
+
+        In the long-audio mode the stable prefix of the hypothesis is committed periodically and dropped
+        from the decoder, so `get_best_path` and the other getters return only the words after it; with
+        `--auto_segment` they return the current segment. Times stay those of the whole stream. Without
+        a listener these words are kept until this call; with one they go to its `on_commit` and
+        `on_segment` instead.
+
+        Returns:
+            tuple: (list of word id's, list of start times, list of durations)
+        """
+
+        cdef vector[int] w
+        cdef vector[int] t
+        cdef vector[int] d
+        cdef float frame_shift = self.thisptr.GetFrameShift()
+        self.thisptr.GetCommittedResult(address(w), address(t), address(d))
+        words = [w[i] for i in xrange(w.size())]
+        times = [t[i] * frame_shift for i in xrange(t.size())]
+        durations = [d[i] * frame_shift for i in xrange(d.size())]
+
+        return (words, times, durations)
+
+    def get_time_alignment_with_word_confidence(self, graph=0):
+        """get_time_alignment_with_word_confidence(self, graph=0)
         Get time alignment of the current 1-best decoding hypothesis.
 
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
         Returns:
             tuple: (list of word id's, list of start times, list of durations)
         """
@@ -165,7 +579,7 @@ cdef class Decoder:
         cdef vector[int] d
         cdef vector[float] c
         cdef float frame_shift = self.thisptr.GetFrameShift()
-        self.thisptr.GetTimeAlignmentWithWordConfidence(address(w), address(t), address(d), address(c))
+        self.thisptr.GetTimeAlignmentWithWordConfidence(address(w), address(t), address(d), address(c), graph)
         words = [w[i] for i in xrange(w.size()) if w[i] != 0]
         times = [t[i] * frame_shift for i in xrange(t.size()) if w[i] != 0]
         durations = [d[i] * frame_shift for i in xrange(d.size()) if w[i] != 0]
@@ -173,6 +587,48 @@ cdef class Decoder:
         return (words, times, durations, c)
 
 
+    def get_confusion_network(self, graph=0):
+        """get_confusion_network(self, graph=0)
+        Get the confusion network (sausage) of the current utterance.
+
+        The network is a time-ordered list of bins of competing words, computed from the
+        determinized lattice in one pass. The best word of each bin together with its posterior
+        gives the 1-best hypothesis with word confidences. Word id 0 stands for "no word".
+
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
+        Returns:
+            list of bins; each bin is a tuple (start time, end time, list of (word id, posterior)
+            sorted by decreasing posterior)
+        """
+        cdef vector[vector[int]] w
+        cdef vector[vector[float]] p
+        cdef vector[float] b
+        cdef vector[float] e
+        cdef float frame_shift = self.thisptr.GetFrameShift()
+        self.thisptr.GetConfusionNetwork(address(w), address(p), address(b), address(e), graph)
+
+        res = []
+        for i in xrange(w.size()):
+            arcs = sorted(((w[i][j], p[i][j]) for j in xrange(w[i].size())), key=lambda x: -x[1])
+            res.append((b[i] * frame_shift, e[i] * frame_shift, arcs))
+
+        return res
+
+    def get_graph_names(self):
+        """get_graph_names(self)
+        Get the names of the graphs searched by the decoder.
+
+        The first graph is the main one ("main"), followed by the graphs of `--extra_graphs`. All of them are
+        searched with the same features and acoustic scores; the `graph` argument of the result getters
+        is an index into this list.
+
+        Returns:
+            list of graph names
+        """
+        return [name.decode('utf8') for name in self.thisptr.GetGraphNames()]
+
     def get_word(self, word_id):
         """get_word(self, word_id)
         Get word string form given word id.
@@ -185,6 +641,34 @@ cdef class Decoder:
         """
         return self.thisptr.GetWord(word_id)
 
+    def checkpoint(self):
+        """checkpoint(self)
+        Save the state of the current utterance, so that it can be restored by another decoder.
+
+        Requires `--enable_checkpoint=true` in the model configuration.
+
+        Returns:
+            bytes with the serialized session
+        """
+        cdef string checkpoint
+        self.thisptr.Checkpoint(address(checkpoint))
+        return checkpoint
+
+    def restore(self, bytes checkpoint):
+        """restore(self, bytes checkpoint)
+        Continue a session saved by checkpoint.
+
+        The decoder has to use the same model as the one which created the checkpoint. The decoding
+        continues with results identical to the original session, including the class phrases set by
+        `set_class_phrases`; the classes set on this decoder before are replaced.
+
+        Args:
+            checkpoint (bytes): Serialized session.
+        """
+        self.thisptr.Restore(checkpoint)
+        self.utt_decoded = self.thisptr.NumFramesDecoded()
+        self._dispatch_events()
+
     def endpoint_detected(self):
         """endpoint_detected(self)
         Has an endpoint been detected?
@@ -206,6 +690,41 @@ cdef class Decoder:
         """
         return self.thisptr.TrailingSilenceLength()
 
+    def get_pool_stats(self):
+        """get_pool_stats(self)
+        Get usage of the decoder's pools of search tokens and lattice links.
+
+        Returns:
+            dict with the number of tokens and links in use and allocated, and the total bytes allocated
+        """
+        cdef DecoderPoolStats stats
+        self.thisptr.GetPoolStats(&stats)
+
+        return {
+            'tokens_used': stats.tokens_used,
+            'tokens_allocated': stats.tokens_allocated,
+            'links_used': stats.links_used,
+            'links_allocated': stats.links_allocated,
+            'bytes': stats.bytes,
+        }
+
+    def get_budget_status(self):
+        """get_budget_status(self)
+        Get which per-utterance limits (--max_session_tokens, --max_session_lattice_arcs,
+        --max_session_frames) the current utterance exceeded.
+
+        Returns:
+            dict with flags beam_tightened, best_path_only and endpoint_forced
+        """
+        cdef SessionBudgetStatus status
+        self.thisptr.GetBudgetStatus(&status)
+
+        return {
+            'beam_tightened': status.beam_tightened,
+            'best_path_only': status.best_path_only,
+            'endpoint_forced': status.endpoint_forced,
+        }
+
     def input_finished(self):
         """input_finished(self)
         Signalize to the decoder that no more input will be added."""
@@ -215,20 +734,78 @@ cdef class Decoder:
         """finalize_decoding(self)
         Finalize the decoding and prepare the internal representation for lattice extration."""
         self.thisptr.FinalizeDecoding()
+        self._dispatch_events()
+
+    def finalize_decoding_async(self, keep_adaptation=False):
+        """finalize_decoding_async(self, keep_adaptation=False)
+        Finalize the decoding and reset the decoder, leaving the final result of the utterance to be
+        computed in the background.
 
-    def reset(self):
-        """reset(self)
-        Reset the decoder for decoding a new utterance."""
-        self.thisptr.Reset()
+        Only the cheap part of `finalize_decoding` runs here; lattice determinization, rescoring, word
+        posteriors, alignment and confidences of the main graph are computed on a worker thread while the
+        decoder takes the next utterance. The results of the extra graphs are not kept.
+
+        Args:
+            keep_adaptation (bool): As in `reset`.
+
+        Returns:
+            FinalResult
+        """
+        cdef FinalResult result = FinalResult()
+        result.frame_shift = self.thisptr.GetFrameShift()
+        result.thisptr = self.thisptr.FinalizeDecodingAsync(keep_adaptation)
+        self.utt_decoded = 0
+        self._dispatch_events()
+        return result
+
+    def reset(self, keep_adaptation=False):
+        """reset(self, keep_adaptation=False)
+        Reset the decoder for decoding a new utterance.
+
+        Args:
+            keep_adaptation (bool): Start the new utterance from the speaker adaptation state
+                (ivector and online CMVN statistics) of the previous one. Use this for consecutive
+                utterances of the same speaker.
+
+        A decoder created from a `ModelManager` switches to newly reloaded models here; the adaptation
+        state is not kept across the switch.
+        """
+        self.thisptr.Reset(keep_adaptation)
+
+    def get_adaptation_state(self):
+        """get_adaptation_state(self)
+        Get the current speaker adaptation state (ivector and online CMVN statistics).
+
+        Returns:
+            bytes with the serialized state, suitable for set_adaptation_state
+        """
+        cdef string state
+        self.thisptr.GetAdaptationState(address(state))
+        return state
 
-    def get_final_relative_cost(self):
-        """get_final_relative_cost(self)
+    def set_adaptation_state(self, bytes state):
+        """set_adaptation_state(self, bytes state)
+        Restore a speaker adaptation state obtained by get_adaptation_state.
+
+        The state is applied to a new utterance, i.e. the decoder is reset. Use
+        reset(keep_adaptation=True) to carry the adaptation on to the following utterances.
+
+        Args:
+            state (bytes): Serialized adaptation state.
+        """
+        self.thisptr.SetAdaptationState(state)
+
+    def get_final_relative_cost(self, graph=0):
+        """get_final_relative_cost(self, graph=0)
         Get the relative cost of the decoding so far of the final states.
 
+        Args:
+            graph (int): Index of the graph to read (see `get_graph_names`).
+
         Returns:
             float cost
         """
-        return self.thisptr.FinalRelativeCost()
+        return self.thisptr.FinalRelativeCost(graph)
 
     def get_num_frames_decoded(self):
         """get_num_frames_decoded(self)
@@ -239,6 +816,17 @@ cdef class Decoder:
         """
         return self.thisptr.NumFramesDecoded()
 
+    def keyword_gated(self):
+        """keyword_gated(self)
+        Whether the decoder only searches the keyword graph (`--keyword_graph`), waiting for a keyword.
+        Until a keyword is found, `decode` returns the frames searched for keywords and no results are
+        available; after it, the utterance (or with `--auto_segment` the segment) is decoded as usual.
+
+        Returns:
+            bool
+        """
+        return self.thisptr.KeywordGated()
+
     def get_ivector(self):
         """get_ivector(self)
         Get Ivector of the latest decoded frame.
@@ -272,6 +860,54 @@ cdef class Decoder:
 
         self.thisptr.SetBitsPerSample(n_bits)
 
+    def get_sampling_rate(self):
+        """get_sampling_rate(self)
+        Get sampling rate of the input audio.
+
+        Returns:
+            int sampling rate in Hz
+        """
+        return self.thisptr.GetInputSamplingFrequency()
+
+    def set_sampling_rate(self, samp_freq):
+        """set_sampling_rate(self, samp_freq)
+        Set sampling rate of the input audio.
+
+        If it differs from the sampling rate of the model, the audio is resampled inside the decoder.
+        Resets the decoder.
+
+        Args:
+            samp_freq (int): Sampling rate in Hz.
+        """
+
+        self.thisptr.SetInputSamplingFrequency(samp_freq)
+
+    def set_class_phrases(self, class_name, phrases, costs=None):
+        """set_class_phrases(self, class_name, phrases, costs=None)
+        Fill a class of the grammar with the given phrases for this session.
+
+        Arcs of G labeled by the class word (e.g. `$CONTACT`) are replaced by the phrases at decode time,
+        without recompiling the graph. Requires on-the-fly composition (`--hcl` and `--g`).
+        Restarts the current utterance.
+
+        Args:
+            class_name (str): Word of the class in the word list.
+            phrases (list): Phrases (str) of space-separated words.
+            costs (list): Cost (float) of each phrase; negative costs boost the phrase. Defaults to 0.
+        """
+        cdef vector[string] c_phrases = [phrase.encode('utf8') for phrase in phrases]
+        cdef vector[float] c_costs = costs if costs is not None else []
+
+        self.thisptr.SetClassPhrases(class_name.encode('utf8'), c_phrases, c_costs)
+
+    def clear_classes(self):
+        """clear_classes(self)
+        Remove the phrases of all classes set by `set_class_phrases`.
+
+        Restarts the current utterance.
+        """
+        self.thisptr.ClearClasses()
+
     def set_spkrID(self, sid):
         self.thisptr.SetSpkrID(sid)
 
@@ -220,3 +220,51 @@ def compact_hyp(hyp_path, comp_hyp_path):
     with open(comp_hyp_path, 'wb') as w:
         for wav, dec_list in d.iteritems():
             w.write('%s %s\n' % (wav, ' '.join(dec_list)))
+
+
+def flat_lattice_arrays(buf):
+    """Unpack a flat lattice buffer (see Decoder.get_lattice_buffer) into numpy arrays.
+
+    The arrays are views into the buffer, no data is copied.
+
+    Args:
+        buf: LatticeBuffer or any object supporting the buffer protocol
+    Returns:
+        dict with the header fields and arrays named as in src/utils.h
+    """
+    import numpy as np
+
+    header = np.frombuffer(buf, dtype=np.int32, count=8)
+    if len(header) == 0 or bytes(bytearray(np.frombuffer(buf, dtype=np.uint8, count=4))) != b'ALAT':
+        raise ValueError('Not a flat lattice buffer.')
+
+    kind, num_states, num_arcs, start, num_alignment = [int(x) for x in header[2:7]]
+    res = {
+        'kind': kind,
+        'start_state': start,
+        'tot_lik': float(np.frombuffer(buf, dtype=np.float32, count=1, offset=28)[0]),
+    }
+
+    fields = [
+        ('state_offsets', np.int32, num_states + 1),
+        ('ilabels', np.int32, num_arcs),
+        ('olabels', np.int32, num_arcs),
+        ('nextstates', np.int32, num_arcs),
+        ('weights', np.float32, num_arcs),
+        ('final_weights', np.float32, num_states),
+    ]
+    if kind == 1:
+        fields += [
+            ('acoustic_weights', np.float32, num_arcs),
+            ('final_acoustic_weights', np.float32, num_states),
+            ('alignment_offsets', np.int32, num_arcs + 1),
+            ('final_alignment_offsets', np.int32, num_states + 1),
+            ('alignment', np.int32, num_alignment),
+        ]
+
+    offset = 32
+    for name, dtype, count in fields:
+        res[name] = np.frombuffer(buf, dtype=dtype, count=count, offset=offset)
+        offset += 4 * count
+
+    return res
@@ -26,11 +26,18 @@ except ImportError:
         raise e
 import copy
 from utils import expand_prefix
+from utils import flat_lattice_arrays
 from utils import fst_shortest_path_to_lists
 import fst
 import os
+import struct
 from subprocess import call
 
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
 
 class TestExpandPref(ut_TestCase):
 
@@ -88,5 +95,55 @@ class TestLatticeToNbest(ut_TestCase):
         self.assertSequenceEqual(nbest_list, self.s_result)
 
 
+@ut_skipIf(numpy is None, 'We need numpy to unpack flat lattice buffers')
+class TestFlatLatticeArrays(ut_TestCase):
+
+    """ Two states and one arc 0 -> 1 with word 5, state 1 final. """
+
+    def make_buffer(self, kind):
+        inf = float('inf')
+        num_alignment = 3 if kind == 1 else 0
+        buf = b'ALAT' + struct.pack('=6if', 1, kind, 2, 1, 0, num_alignment, 1.5)
+        buf += struct.pack('=3i', 0, 1, 1)  # state_offsets
+        buf += struct.pack('=3i', 5, 5, 1)  # ilabels, olabels, nextstates
+        buf += struct.pack('=f', 0.5)  # weights
+        buf += struct.pack('=2f', inf, 0.25)  # final_weights
+        if kind == 1:
+            buf += struct.pack('=f', 2.0)  # acoustic_weights
+            buf += struct.pack('=2f', inf, 0.0)  # final_acoustic_weights
+            buf += struct.pack('=2i', 0, 3)  # alignment_offsets
+            buf += struct.pack('=3i', 0, 0, 0)  # final_alignment_offsets
+            buf += struct.pack('=3i', 7, 7, 8)  # alignment
+        return buf
+
+    def check_words_post(self, res, kind):
+        self.assertEqual(res['kind'], kind)
+        self.assertEqual(res['start_state'], 0)
+        self.assertAlmostEqual(res['tot_lik'], 1.5)
+        self.assertEqual(list(res['state_offsets']), [0, 1, 1])
+        self.assertEqual(list(res['ilabels']), [5])
+        self.assertEqual(list(res['olabels']), [5])
+        self.assertEqual(list(res['nextstates']), [1])
+        self.assertEqual(list(res['weights']), [0.5])
+        self.assertEqual(list(res['final_weights']), [float('inf'), 0.25])
+
+    def test_words_post(self):
+        res = flat_lattice_arrays(self.make_buffer(0))
+        self.check_words_post(res, 0)
+        self.assertFalse('alignment' in res)
+
+    def test_compact_lattice(self):
+        res = flat_lattice_arrays(self.make_buffer(1))
+        self.check_words_post(res, 1)
+        self.assertEqual(list(res['acoustic_weights']), [2.0])
+        self.assertEqual(list(res['final_acoustic_weights']), [float('inf'), 0.0])
+        self.assertEqual(list(res['alignment_offsets']), [0, 3])
+        self.assertEqual(list(res['final_alignment_offsets']), [0, 0, 0])
+        self.assertEqual(list(res['alignment']), [7, 7, 8])
+
+    def test_not_a_buffer(self):
+        self.assertRaises(ValueError, flat_lattice_arrays, b'XLAT' + b'\0' * 28)
+
+
 if __name__ == '__main__':
     ut_main()
@@ -0,0 +1,187 @@
+#include "src/async_feature.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    OnlineAsyncFeature::OnlineAsyncFeature(OnlineBaseFeature *src, int32 max_queue_size) :
+            src_(src),
+            dim_(src->Dim()),
+            frame_shift_(src->FrameShiftInSeconds()),
+            max_queue_size_(max_queue_size),
+            busy_(false),
+            input_finished_(false),
+            output_finished_(false),
+            stop_(false)
+    {
+        KALDI_ASSERT(max_queue_size_ > 0);
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&work_cond_, NULL);
+        pthread_cond_init(&state_cond_, NULL);
+
+        if(pthread_create(&thread_, NULL, &OnlineAsyncFeature::RunWorker, this) != 0) {
+            KALDI_ERR << "Could not start feature extraction thread.";
+        }
+    }
+
+    OnlineAsyncFeature::~OnlineAsyncFeature() {
+        pthread_mutex_lock(&mutex_);
+        stop_ = true;
+        pthread_cond_broadcast(&work_cond_);
+        pthread_mutex_unlock(&mutex_);
+        pthread_join(thread_, NULL);
+
+        for(size_t i = 0; i < queue_.size(); i++) {
+            delete queue_[i].waveform;
+        }
+        for(size_t i = 0; i < frames_.size(); i++) {
+            delete frames_[i];
+        }
+        delete src_;
+        src_ = NULL;
+
+        pthread_cond_destroy(&state_cond_);
+        pthread_cond_destroy(&work_cond_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    int32 OnlineAsyncFeature::Dim() const {
+        return dim_;
+    }
+
+    BaseFloat OnlineAsyncFeature::FrameShiftInSeconds() const {
+        return frame_shift_;
+    }
+
+    int32 OnlineAsyncFeature::NumFramesReady() const {
+        pthread_mutex_lock(&mutex_);
+        WaitUntilIdle();
+        int32 num_frames = frames_.size();
+        pthread_mutex_unlock(&mutex_);
+
+        return num_frames;
+    }
+
+    bool OnlineAsyncFeature::IsLastFrame(int32 frame) const {
+        pthread_mutex_lock(&mutex_);
+        WaitUntilIdle();
+        bool is_last = output_finished_ && frame == static_cast<int32>(frames_.size()) - 1;
+        pthread_mutex_unlock(&mutex_);
+
+        return is_last;
+    }
+
+    void OnlineAsyncFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+        pthread_mutex_lock(&mutex_);
+        if(frame >= static_cast<int32>(frames_.size())) {
+            WaitUntilIdle();
+        }
+        KALDI_ASSERT(frame >= 0 && frame < static_cast<int32>(frames_.size()));
+        feat->CopyFromVec(*frames_[frame]);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void OnlineAsyncFeature::AcceptWaveform(BaseFloat sampling_rate,
+                                            const VectorBase<BaseFloat> &waveform) {
+        Chunk chunk;
+        chunk.sampling_rate = sampling_rate;
+        chunk.waveform = new Vector<BaseFloat>(waveform);
+
+        pthread_mutex_lock(&mutex_);
+        KALDI_ASSERT(!input_finished_);
+        // Backpressure: do not let the caller run arbitrarily far ahead.
+        while(static_cast<int32>(queue_.size()) >= max_queue_size_ && error_ == "") {
+            pthread_cond_wait(&state_cond_, &mutex_);
+        }
+        if(error_ != "") {
+            std::string error = error_;
+            pthread_mutex_unlock(&mutex_);
+            delete chunk.waveform;
+            KALDI_ERR << "Feature extraction failed: " << error;
+        }
+        queue_.push_back(chunk);
+        pthread_cond_signal(&work_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void OnlineAsyncFeature::InputFinished() {
+        pthread_mutex_lock(&mutex_);
+        input_finished_ = true;
+        pthread_cond_signal(&work_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void OnlineAsyncFeature::WaitUntilIdle() const {
+        while((busy_ || !queue_.empty() || (input_finished_ && !output_finished_)) && error_ == "") {
+            pthread_cond_wait(&state_cond_, &mutex_);
+        }
+        if(error_ != "") {
+            std::string error = error_;
+            pthread_mutex_unlock(&mutex_);
+            KALDI_ERR << "Feature extraction failed: " << error;
+        }
+    }
+
+    void *OnlineAsyncFeature::RunWorker(void *self) {
+        static_cast<OnlineAsyncFeature*>(self)->Worker();
+        return NULL;
+    }
+
+    void OnlineAsyncFeature::Worker() {
+        try {
+            while(true) {
+                pthread_mutex_lock(&mutex_);
+                while(queue_.empty() && !(input_finished_ && !output_finished_) && !stop_) {
+                    pthread_cond_wait(&work_cond_, &mutex_);
+                }
+                if(stop_) {
+                    pthread_mutex_unlock(&mutex_);
+                    return;
+                }
+                if(queue_.empty()) {
+                    // Input finished and all audio processed.
+                    busy_ = true;
+                    pthread_mutex_unlock(&mutex_);
+
+                    src_->InputFinished();
+                    PublishFrames(true);
+                    return;
+                }
+                Chunk chunk = queue_.front();
+                queue_.pop_front();
+                busy_ = true;
+                pthread_cond_broadcast(&state_cond_);
+                pthread_mutex_unlock(&mutex_);
+
+                src_->AcceptWaveform(chunk.sampling_rate, *chunk.waveform);
+                delete chunk.waveform;
+                PublishFrames(false);
+            }
+        } catch(const std::exception &e) {
+            pthread_mutex_lock(&mutex_);
+            error_ = e.what();
+            busy_ = false;
+            pthread_cond_broadcast(&state_cond_);
+            pthread_mutex_unlock(&mutex_);
+        }
+    }
+
+    void OnlineAsyncFeature::PublishFrames(bool input_finished) {
+        // Only the worker touches src_ and appends to frames_, so the new
+        // frames can be copied out without holding the lock.
+        int32 num_published = frames_.size(),
+              num_ready = src_->NumFramesReady();
+        std::vector<Vector<BaseFloat>*> new_frames;
+        for(int32 frame = num_published; frame < num_ready; frame++) {
+            Vector<BaseFloat> *feat = new Vector<BaseFloat>(dim_);
+            src_->GetFrame(frame, feat);
+            new_frames.push_back(feat);
+        }
+
+        pthread_mutex_lock(&mutex_);
+        frames_.insert(frames_.end(), new_frames.begin(), new_frames.end());
+        output_finished_ = input_finished;
+        busy_ = false;
+        pthread_cond_broadcast(&state_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+}
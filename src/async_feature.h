@@ -0,0 +1,68 @@
+#ifndef ALEX_ASR_ASYNC_FEATURE_H_
+#define ALEX_ASR_ASYNC_FEATURE_H_
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "feat/online-feature.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Runs an OnlineBaseFeature on its own worker thread. AcceptWaveform only
+    // queues the audio (blocking if more than max_queue_size chunks are
+    // pending) and the wrapped feature is computed in the background. Readers
+    // synchronize with the worker when they ask how many frames are ready, so
+    // the output is identical to running the wrapped feature synchronously.
+    class OnlineAsyncFeature : public OnlineBaseFeature {
+    public:
+        // Takes ownership of src.
+        OnlineAsyncFeature(OnlineBaseFeature *src, int32 max_queue_size);
+        virtual ~OnlineAsyncFeature();
+
+        virtual int32 Dim() const;
+        virtual int32 NumFramesReady() const;
+        virtual bool IsLastFrame(int32 frame) const;
+        virtual BaseFloat FrameShiftInSeconds() const;
+        virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+        virtual void AcceptWaveform(BaseFloat sampling_rate,
+                                    const VectorBase<BaseFloat> &waveform);
+        virtual void InputFinished();
+    private:
+        struct Chunk {
+            BaseFloat sampling_rate;
+            Vector<BaseFloat> *waveform;
+        };
+
+        static void *RunWorker(void *self);
+        void Worker();
+        void PublishFrames(bool input_finished);
+        // Waits until the worker has processed all queued audio. Expects
+        // mutex_ to be locked.
+        void WaitUntilIdle() const;
+
+        OnlineBaseFeature *src_;
+        int32 dim_;
+        BaseFloat frame_shift_;
+        int32 max_queue_size_;
+
+        pthread_t thread_;
+        mutable pthread_mutex_t mutex_;
+        // Signalled when there is new work for the worker.
+        pthread_cond_t work_cond_;
+        // Signalled when the worker consumed a chunk or published frames.
+        mutable pthread_cond_t state_cond_;
+
+        std::deque<Chunk> queue_;
+        bool busy_;
+        bool input_finished_;
+        bool output_finished_;
+        bool stop_;
+        std::string error_;
+        std::vector<Vector<BaseFloat>*> frames_;
+    };
+}
+
+#endif  // ALEX_ASR_ASYNC_FEATURE_H_
@@ -0,0 +1,60 @@
+#ifndef ALEX_ASR_DECODABLE_CHUNKED_H_
+#define ALEX_ASR_DECODABLE_CHUNKED_H_
+
+#include "itf/decodable-itf.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Decodable that makes the frames of the wrapped one available in whole
+    // chunks of chunk_size frames, and all of them once the input is
+    // finished. The nnet3 decodable evaluates the network for the frames
+    // ready when a frame is first asked for, together with their left and
+    // right context; holding back partial chunks makes every evaluation
+    // cover at least a chunk, instead of recomputing the context for each
+    // few frames that arrive with a small audio block.
+    class DecodableChunked : public DecodableInterface {
+    public:
+        // Takes ownership of decodable.
+        DecodableChunked(DecodableInterface *decodable, int32 chunk_size) :
+                decodable_(decodable), chunk_size_(chunk_size), input_finished_(false) {
+            KALDI_ASSERT(chunk_size > 0);
+        }
+        virtual ~DecodableChunked() {
+            delete decodable_;
+        }
+
+        // No more frames will come; the last partial chunk becomes available.
+        void InputFinished() {
+            input_finished_ = true;
+        }
+
+        virtual BaseFloat LogLikelihood(int32 frame, int32 index) {
+            return decodable_->LogLikelihood(frame, index);
+        }
+
+        virtual bool IsLastFrame(int32 frame) const {
+            return decodable_->IsLastFrame(frame);
+        }
+
+        virtual int32 NumFramesReady() const {
+            int32 num_frames = decodable_->NumFramesReady();
+            if(input_finished_) {
+                return num_frames;
+            }
+            return num_frames - num_frames % chunk_size_;
+        }
+
+        virtual int32 NumIndices() const {
+            return decodable_->NumIndices();
+        }
+    private:
+        DecodableInterface *decodable_;
+        int32 chunk_size_;
+        bool input_finished_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableChunked);
+    };
+}
+
+#endif  // ALEX_ASR_DECODABLE_CHUNKED_H_
@@ -0,0 +1,46 @@
+#ifndef ALEX_ASR_DECODABLE_OFFSET_H_
+#define ALEX_ASR_DECODABLE_OFFSET_H_
+
+#include "itf/decodable-itf.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Decodable whose frame t is frame t - offset of the wrapped one; frames
+    // before the offset are not available. Used when the feature pipeline of
+    // a long utterance is restarted part way, so that the search keeps the
+    // frame numbers of the whole utterance.
+    class DecodableFrameOffset : public DecodableInterface {
+    public:
+        // Takes ownership of decodable.
+        DecodableFrameOffset(DecodableInterface *decodable, int32 offset) :
+                decodable_(decodable), offset_(offset) { }
+        virtual ~DecodableFrameOffset() {
+            delete decodable_;
+        }
+
+        virtual BaseFloat LogLikelihood(int32 frame, int32 index) {
+            KALDI_ASSERT(frame >= offset_);
+            return decodable_->LogLikelihood(frame - offset_, index);
+        }
+
+        virtual bool IsLastFrame(int32 frame) const {
+            return decodable_->IsLastFrame(frame - offset_);
+        }
+
+        virtual int32 NumFramesReady() const {
+            return offset_ + decodable_->NumFramesReady();
+        }
+
+        virtual int32 NumIndices() const {
+            return decodable_->NumIndices();
+        }
+    private:
+        DecodableInterface *decodable_;
+        int32 offset_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableFrameOffset);
+    };
+}
+
+#endif  // ALEX_ASR_DECODABLE_OFFSET_H_
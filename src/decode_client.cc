@@ -0,0 +1,171 @@
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+
+#include "feat/wave-reader.h"
+#include "src/stream_protocol.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+using namespace alex_asr;
+
+namespace {
+    struct ClientOptions {
+        BaseFloat chunk_ms;
+        bool realtime;
+
+        ClientOptions() : chunk_ms(100.0), realtime(false) { }
+
+        void Register(OptionsItf *po) {
+            po->Register("chunk-ms", &chunk_ms, "Length of the audio messages in milliseconds.");
+            po->Register("realtime", &realtime, "Send the audio at the speed it would be recorded.");
+        }
+    };
+
+    pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    struct Stream {
+        const ClientOptions *opts;
+        std::string address;
+        std::string wav_rxfilename;
+        int fd;
+        bool ok;
+    };
+
+    void Print(const Stream *stream, char type, const std::string &text) {
+        pthread_mutex_lock(&output_mutex);
+        std::cout << stream->wav_rxfilename << '\t' << type << '\t' << text << std::endl;
+        pthread_mutex_unlock(&output_mutex);
+    }
+
+    // Prints the messages of the server until it closes the stream.
+    void *ReceiveResults(void *arg) {
+        Stream *stream = static_cast<Stream *>(arg);
+        try {
+            char type;
+            std::string payload;
+            while(ReadStreamMessage(stream->fd, &type, &payload)) {
+                Print(stream, type, payload);
+                if(type == kStreamError) {
+                    stream->ok = false;
+                }
+            }
+        } catch(const std::exception &e) {
+            KALDI_WARN << stream->wav_rxfilename << ": " << e.what();
+            stream->ok = false;
+        }
+        return NULL;
+    }
+
+    void SendWave(Stream *stream) {
+        WaveData wave_data;
+        {
+            Input ki(stream->wav_rxfilename);
+            wave_data.Read(ki.Stream());
+        }
+        SubVector<BaseFloat> waveform(wave_data.Data(), 0);
+        int32 samp_freq = static_cast<int32>(wave_data.SampFreq());
+
+        std::ostringstream rate;
+        rate << samp_freq;
+        WriteStreamMessage(stream->fd, kStreamSamplingRate, rate.str());
+
+        int32 chunk_size = std::max(1, static_cast<int32>(samp_freq * stream->opts->chunk_ms / 1000));
+        std::string chunk;
+        for(int32 offset = 0; offset < waveform.Dim(); offset += chunk_size) {
+            int32 num_samples = std::min(chunk_size, waveform.Dim() - offset);
+            chunk.resize(num_samples * 2);
+            for(int32 i = 0; i < num_samples; i++) {
+                int16 sample = static_cast<int16>(waveform(offset + i));
+                chunk[2 * i] = static_cast<char>(sample & 0xff);
+                chunk[2 * i + 1] = static_cast<char>((sample >> 8) & 0xff);
+            }
+            WriteStreamMessage(stream->fd, kStreamAudio, chunk);
+            if(stream->opts->realtime) {
+                usleep(static_cast<useconds_t>(num_samples * 1000000.0 / samp_freq));
+            }
+        }
+        WriteStreamMessage(stream->fd, kStreamEndOfUtterance, "");
+    }
+
+    void *RunStream(void *arg) {
+        Stream *stream = static_cast<Stream *>(arg);
+        pthread_t receiver;
+        try {
+            stream->fd = ConnectStream(stream->address);
+        } catch(const std::exception &e) {
+            KALDI_WARN << stream->wav_rxfilename << ": " << e.what();
+            stream->ok = false;
+            return NULL;
+        }
+        if(pthread_create(&receiver, NULL, &ReceiveResults, stream) != 0) {
+            KALDI_WARN << "Could not start receiver thread.";
+            stream->ok = false;
+            close(stream->fd);
+            return NULL;
+        }
+
+        try {
+            SendWave(stream);
+        } catch(const std::exception &e) {
+            KALDI_WARN << stream->wav_rxfilename << ": " << e.what();
+            stream->ok = false;
+        }
+        // The server sends the final result and closes the stream.
+        shutdown(stream->fd, SHUT_WR);
+        pthread_join(receiver, NULL);
+        close(stream->fd);
+        return NULL;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Replays WAV files to decode_server, each on its own stream and all of them at\n"
+                "once, and prints what the server sends back: one line per message with the file,\n"
+                "the message type (P partial, S stable, N endpoint, C committed, F final, X error)\n"
+                "and the text.\n"
+                "\n"
+                "Usage:  decode_client [options] <address> <wav-rxfilename> [<wav-rxfilename> ...]\n"
+                " e.g.:  decode_client --realtime=true unix:/tmp/alex_asr.sock a.wav b.wav\n";
+
+        ParseOptions po(usage);
+        ClientOptions opts;
+        opts.Register(&po);
+        po.Read(argc, argv);
+
+        if(po.NumArgs() < 2 || opts.chunk_ms <= 0) {
+            po.PrintUsage();
+            exit(1);
+        }
+
+        std::vector<Stream> streams(po.NumArgs() - 1);
+        std::vector<pthread_t> threads(streams.size());
+        for(size_t i = 0; i < streams.size(); i++) {
+            streams[i].opts = &opts;
+            streams[i].address = po.GetArg(1);
+            streams[i].wav_rxfilename = po.GetArg(i + 2);
+            streams[i].fd = -1;
+            streams[i].ok = true;
+            if(pthread_create(&threads[i], NULL, &RunStream, &streams[i]) != 0) {
+                KALDI_ERR << "Could not start stream thread.";
+            }
+        }
+
+        int32 num_failed = 0;
+        for(size_t i = 0; i < streams.size(); i++) {
+            pthread_join(threads[i], NULL);
+            if(!streams[i].ok) num_failed++;
+        }
+        KALDI_LOG << "Decoded " << streams.size() - num_failed << " streams, " << num_failed << " failed.";
+
+        return num_failed == 0 ? 0 : 1;
+    } catch(const std::exception &e) {
+        std::cerr << e.what();
+        return -1;
+    }
+}
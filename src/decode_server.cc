@@ -0,0 +1,433 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include "src/decoder.h"
+#include "src/decoder_model.h"
+#include "src/stream_protocol.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+using namespace alex_asr;
+
+namespace {
+    struct ServerOptions {
+        int32 num_workers;
+        int32 max_sessions;
+        int32 max_pending_chunks;
+        BaseFloat send_timeout;
+
+        ServerOptions() : num_workers(4), max_sessions(64), max_pending_chunks(16), send_timeout(5.0) { }
+
+        void Register(OptionsItf *po) {
+            po->Register("num-workers", &num_workers, "Number of threads decoding the streams.");
+            po->Register("max-sessions", &max_sessions, "Maximum number of open streams; further "
+                    "connections are refused with an error message.");
+            po->Register("max-pending-chunks", &max_pending_chunks, "Maximum number of messages of a "
+                    "stream waiting for a worker. When it is reached, the server stops reading the "
+                    "stream, so that the client is slowed down by the socket.");
+            po->Register("send-timeout", &send_timeout, "Seconds a worker waits for a client to "
+                    "take a result; a client that does not read for longer is disconnected, so that "
+                    "it cannot hold up the workers.");
+        }
+    };
+
+    std::string WordsToString(Decoder *decoder, const std::vector<int32> &words) {
+        std::string text;
+        for(size_t i = 0; i < words.size(); i++) {
+            if(i > 0) text += " ";
+            text += decoder->GetWord(words[i]);
+        }
+        return text;
+    }
+
+    // Sends the results of a stream back to its client as they change. The
+    // socket has a send timeout, so a client that stops reading makes Send()
+    // throw rather than block the worker.
+    class StreamListener : public DecoderListener {
+    public:
+        StreamListener(int fd, Decoder *decoder) : fd_(fd), decoder_(decoder), send_failed_(false) { }
+
+        void Send(char type, const std::string &payload) {
+            try {
+                WriteStreamMessage(fd_, type, payload);
+            } catch(...) {
+                send_failed_ = true;
+                throw;
+            }
+        }
+
+        // Whether a message could not be sent; nothing more is sent then.
+        bool SendFailed() const { return send_failed_; }
+
+        virtual void OnPartialResult(const std::vector<int32> &words) {
+            Send(kStreamPartial, WordsToString(decoder_, words));
+        }
+
+        virtual void OnStablePrefix(const std::vector<int32> &words) {
+            Send(kStreamStable, WordsToString(decoder_, words));
+        }
+
+        virtual void OnEndpoint() {
+            Send(kStreamEndpoint, "");
+        }
+
+        virtual void OnCommit(const std::vector<int32> &words, const std::vector<int32> &times,
+                              const std::vector<int32> &lengths) {
+            Send(kStreamCommit, WordsToString(decoder_, words));
+        }
+
+        virtual void OnSegment(const std::vector<int32> &words, const std::vector<int32> &times,
+                               const std::vector<int32> &lengths) {
+            Send(kStreamCommit, WordsToString(decoder_, words));
+        }
+    private:
+        int fd_;
+        Decoder *decoder_;
+        bool send_failed_;
+    };
+
+    struct Session {
+        int fd;
+        Decoder *decoder;
+        StreamListener *listener;
+        bool in_utterance;
+
+        // Messages read from the stream and not processed yet; an empty type
+        // marks the end of the stream. Guarded by mutex.
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        std::deque<std::pair<char, std::string> > pending;
+        bool scheduled;  // Waiting for a worker or being processed.
+        bool failed;  // A worker gave up on the stream; the reader stops.
+        int32 ref_count;  // The reader thread and the workers.
+    };
+
+    class DecodeServer {
+    public:
+        DecodeServer(const ServerOptions &opts, ModelManager *models) :
+                opts_(opts), models_(models), num_sessions_(0) {
+            pthread_mutex_init(&mutex_, NULL);
+            pthread_cond_init(&ready_cond_, NULL);
+        }
+
+        void Run(int listen_fd) {
+            for(int32 i = 0; i < opts_.num_workers; i++) {
+                pthread_t thread;
+                if(pthread_create(&thread, NULL, &DecodeServer::RunWorker, this) != 0) {
+                    KALDI_ERR << "Could not start worker thread.";
+                }
+                pthread_detach(thread);
+            }
+
+            while(true) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if(fd < 0) {
+                    if(errno != EINTR) {
+                        KALDI_WARN << "accept() failed: " << strerror(errno);
+                    }
+                    continue;
+                }
+                Accept(fd);
+            }
+        }
+    private:
+        struct ReaderArgs {
+            DecodeServer *server;
+            Session *session;
+        };
+
+        void Accept(int fd) {
+            struct timeval timeout;
+            timeout.tv_sec = static_cast<time_t>(opts_.send_timeout);
+            timeout.tv_usec = static_cast<suseconds_t>((opts_.send_timeout - timeout.tv_sec) * 1.0e6);
+            if(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+                KALDI_WARN << "Could not set the send timeout: " << strerror(errno);
+            }
+
+            pthread_mutex_lock(&mutex_);
+            bool full = num_sessions_ >= opts_.max_sessions;
+            if(!full) num_sessions_++;
+            pthread_mutex_unlock(&mutex_);
+
+            if(full) {
+                KALDI_WARN << "Refusing a stream: " << opts_.max_sessions << " streams are open.";
+                try {
+                    WriteStreamMessage(fd, kStreamError, "The server is busy.");
+                } catch(...) { }
+                close(fd);
+                return;
+            }
+
+            Session *session = new Session();
+            session->fd = fd;
+            session->decoder = NULL;
+            session->listener = NULL;
+            session->in_utterance = false;
+            pthread_mutex_init(&session->mutex, NULL);
+            pthread_cond_init(&session->cond, NULL);
+            session->scheduled = false;
+            session->failed = false;
+            session->ref_count = 1;
+            try {
+                session->decoder = new Decoder(models_);
+                session->listener = new StreamListener(fd, session->decoder);
+                session->decoder->SetListener(session->listener);
+            } catch(const std::exception &e) {
+                Fail(session, e.what());
+                Unref(session);
+                return;
+            }
+
+            ReaderArgs *args = new ReaderArgs();
+            args->server = this;
+            args->session = session;
+            pthread_t thread;
+            if(pthread_create(&thread, NULL, &DecodeServer::RunReader, args) != 0) {
+                delete args;
+                Fail(session, "Could not start reader thread.");
+                Unref(session);
+                return;
+            }
+            pthread_detach(thread);
+        }
+
+        static void *RunReader(void *arg) {
+            ReaderArgs *args = static_cast<ReaderArgs *>(arg);
+            args->server->ReadStream(args->session);
+            delete args;
+            return NULL;
+        }
+
+        void ReadStream(Session *session) {
+            while(true) {
+                char type = 0;
+                std::string payload;
+                bool ok;
+                try {
+                    ok = ReadStreamMessage(session->fd, &type, &payload);
+                } catch(const std::exception &e) {
+                    KALDI_WARN << "Stream closed: " << e.what();
+                    ok = false;
+                }
+                if(!ok) type = 0;  // The end of the stream.
+
+                pthread_mutex_lock(&session->mutex);
+                while(static_cast<int32>(session->pending.size()) >= opts_.max_pending_chunks &&
+                        !session->failed) {
+                    pthread_cond_wait(&session->cond, &session->mutex);
+                }
+                bool failed = session->failed;
+                if(!failed) {
+                    session->pending.push_back(std::make_pair(type, std::string()));
+                    session->pending.back().second.swap(payload);
+                    Schedule(session);
+                }
+                pthread_mutex_unlock(&session->mutex);
+
+                if(failed || type == 0) break;
+            }
+            Unref(session);
+        }
+
+        // Queues the session for the workers; called with its mutex held.
+        void Schedule(Session *session) {
+            if(session->scheduled) return;
+            session->scheduled = true;
+            session->ref_count++;
+
+            pthread_mutex_lock(&mutex_);
+            ready_.push_back(session);
+            pthread_cond_signal(&ready_cond_);
+            pthread_mutex_unlock(&mutex_);
+        }
+
+        static void *RunWorker(void *arg) {
+            static_cast<DecodeServer *>(arg)->Work();
+            return NULL;
+        }
+
+        void Work() {
+            while(true) {
+                pthread_mutex_lock(&mutex_);
+                while(ready_.empty()) {
+                    pthread_cond_wait(&ready_cond_, &mutex_);
+                }
+                Session *session = ready_.front();
+                ready_.pop_front();
+                pthread_mutex_unlock(&mutex_);
+
+                std::deque<std::pair<char, std::string> > messages;
+                pthread_mutex_lock(&session->mutex);
+                messages.swap(session->pending);
+                pthread_cond_broadcast(&session->cond);  // Room for the reader again.
+                pthread_mutex_unlock(&session->mutex);
+
+                try {
+                    Process(session, &messages);
+                } catch(const std::exception &e) {
+                    Fail(session, e.what());
+                }
+
+                // Other streams get a turn before this one continues.
+                pthread_mutex_lock(&session->mutex);
+                session->scheduled = false;
+                if(!session->pending.empty() && !session->failed) {
+                    Schedule(session);
+                }
+                pthread_mutex_unlock(&session->mutex);
+                Unref(session);
+            }
+        }
+
+        void Process(Session *session, std::deque<std::pair<char, std::string> > *messages) {
+            Decoder *decoder = session->decoder;
+            for(size_t i = 0; i < messages->size(); i++) {
+                char type = (*messages)[i].first;
+                std::string &payload = (*messages)[i].second;
+                switch(type) {
+                    case kStreamAudio:
+                        decoder->FrameIn(reinterpret_cast<unsigned char *>(&payload[0]), payload.size());
+                        session->in_utterance = true;
+                        break;
+                    case kStreamSamplingRate:
+                    {
+                        int32 samp_freq;
+                        if(session->in_utterance) {
+                            KALDI_ERR << "The sampling rate can only be changed between utterances.";
+                        }
+                        if(!ConvertStringToInteger(payload, &samp_freq) || samp_freq <= 0) {
+                            KALDI_ERR << "Invalid sampling rate: " << payload;
+                        }
+                        decoder->SetInputSamplingFrequency(samp_freq);
+                        break;
+                    }
+                    case kStreamEndOfUtterance:
+                        FinishUtterance(session);
+                        break;
+                    case 0:
+                        if(session->in_utterance) {
+                            FinishUtterance(session);
+                        }
+                        Fail(session, "");
+                        return;
+                    default:
+                        KALDI_ERR << "Unknown message type " << static_cast<int>(type);
+                }
+            }
+            decoder->Decode(-1);
+        }
+
+        void FinishUtterance(Session *session) {
+            Decoder *decoder = session->decoder;
+            decoder->InputFinished();
+            decoder->Decode(-1);
+
+            std::vector<int32> words;
+            if(decoder->NumFramesDecoded() > 0) {
+                BaseFloat prob;
+                decoder->FinalizeDecoding();
+                decoder->GetBestPath(&words, &prob);
+            }
+            session->listener->Send(kStreamFinal, WordsToString(decoder, words));
+
+            // The next utterance of the stream comes from the same speaker.
+            decoder->Reset(true);
+            session->in_utterance = false;
+        }
+
+        // Stops the stream; error is sent to the client unless it is empty.
+        void Fail(Session *session, const std::string &error) {
+            if(!error.empty()) {
+                KALDI_WARN << "Stream failed: " << error;
+                // A client that did not take the last message would not take
+                // this one either.
+                if(session->listener == NULL || !session->listener->SendFailed()) {
+                    try {
+                        WriteStreamMessage(session->fd, kStreamError, error);
+                    } catch(...) { }
+                }
+            }
+            // Wake up the reader blocked in read() or waiting for room.
+            shutdown(session->fd, SHUT_RDWR);
+
+            pthread_mutex_lock(&session->mutex);
+            session->failed = true;
+            session->pending.clear();
+            pthread_cond_broadcast(&session->cond);
+            pthread_mutex_unlock(&session->mutex);
+        }
+
+        void Unref(Session *session) {
+            pthread_mutex_lock(&session->mutex);
+            bool last = (--session->ref_count == 0);
+            pthread_mutex_unlock(&session->mutex);
+            if(!last) return;
+
+            delete session->decoder;
+            delete session->listener;
+            close(session->fd);
+            pthread_mutex_destroy(&session->mutex);
+            pthread_cond_destroy(&session->cond);
+            delete session;
+
+            pthread_mutex_lock(&mutex_);
+            num_sessions_--;
+            pthread_mutex_unlock(&mutex_);
+        }
+
+        ServerOptions opts_;
+        ModelManager *models_;
+
+        pthread_mutex_t mutex_;
+        pthread_cond_t ready_cond_;
+        std::deque<Session *> ready_;  // Sessions with messages for the workers.
+        int32 num_sessions_;
+    };
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Streaming decoding server. Loads the model once and decodes audio streams sent over\n"
+                "a local socket, sending back partial and final results (see src/stream_protocol.h).\n"
+                "\n"
+                "Usage:  decode_server [options] <model-dir> <address>\n"
+                " e.g.:  decode_server --num-workers=4 asr_model_dir unix:/tmp/alex_asr.sock\n"
+                "        decode_server asr_model_dir tcp:5050\n";
+
+        ParseOptions po(usage);
+        ServerOptions opts;
+        opts.Register(&po);
+        po.Read(argc, argv);
+
+        if(po.NumArgs() != 2 || opts.num_workers <= 0 || opts.max_sessions <= 0 ||
+                opts.max_pending_chunks <= 0 || opts.send_timeout <= 0.0) {
+            po.PrintUsage();
+            exit(1);
+        }
+
+        std::string model_dir = po.GetArg(1),
+                address = po.GetArg(2);
+
+        signal(SIGPIPE, SIG_IGN);
+
+        ModelManager models(model_dir);
+        int listen_fd = ListenStream(address, opts.max_sessions);
+        KALDI_LOG << "Listening on " << address;
+
+        DecodeServer server(opts, &models);
+        server.Run(listen_fd);
+
+        return 0;
+    } catch(const std::exception &e) {
+        std::cerr << e.what();
+        return -1;
+    }
+}
@@ -1,6 +1,8 @@
 #include "src/decoder.h"
 #include "src/utils.h"
 
+#include <algorithm>
+
 #include "online2/onlinebin-util.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/sausages.h"
@@ -10,167 +12,609 @@ using namespace kaldi;
 namespace alex_asr {
 
     Decoder::Decoder(const string model_path) :
+            model_(NULL),
+            manager_(NULL),
+            config_(NULL),
+            session_(NULL),
             feature_pipeline_(NULL),
             hclg_(NULL),
+            composed_hclg_(NULL),
+            g_classes_(NULL),
             decoder_(NULL),
-            trans_model_(NULL),
-            am_nnet2_(NULL),
-            am_nnet3_(NULL),
-            am_gmm_(NULL),
-            words_(NULL),
-            config_(NULL),
+            keyword_decoder_(NULL),
             decodable_(NULL),
-            word_boundary_info_(NULL)
-
+            chunked_decodable_(NULL),
+            adaptation_state_(NULL),
+            session_log_(NULL),
+            listener_(NULL),
+            finalize_worker_(NULL),
+            num_stable_words_(0),
+            endpoint_reported_(false),
+            input_finished_(false),
+            num_input_samples_(0),
+            feature_start_frame_(0),
+            pipeline_audio_start_(0),
+            keyword_gated_(false),
+            keyword_gate_frame_(0)
     {
-        // Change dir to model_path. Change back when leaving the scope.
-        local_cwd cwd_to_model_path(model_path);
-        KALDI_VLOG(2) << "Decoder is setting up models: " << model_path;
-
-        ParseConfig();
-        LoadDecoder();
-        Reset();
+        model_ = DecoderModel::Load(model_path);
+        Init();
+    }
 
-        KALDI_VLOG(2) << "Decoder is successfully initialized.";
+    Decoder::Decoder(ModelManager *manager) :
+            model_(NULL),
+            manager_(manager),
+            config_(NULL),
+            session_(NULL),
+            feature_pipeline_(NULL),
+            hclg_(NULL),
+            composed_hclg_(NULL),
+            g_classes_(NULL),
+            decoder_(NULL),
+            keyword_decoder_(NULL),
+            decodable_(NULL),
+            chunked_decodable_(NULL),
+            adaptation_state_(NULL),
+            session_log_(NULL),
+            listener_(NULL),
+            finalize_worker_(NULL),
+            num_stable_words_(0),
+            endpoint_reported_(false),
+            input_finished_(false),
+            num_input_samples_(0),
+            feature_start_frame_(0),
+            pipeline_audio_start_(0),
+            keyword_gated_(false),
+            keyword_gate_frame_(0)
+    {
+        model_ = manager->AcquireModel();
+        Init();
     }
 
     Decoder::~Decoder() {
+        // Waits for the pending final results; they still need the model.
+        delete finalize_worker_;
+        finalize_worker_ = NULL;
+        delete decodable_;
+        decodable_ = NULL;
+        chunked_decodable_ = NULL;
         delete feature_pipeline_;
         feature_pipeline_ = NULL;
-        delete hclg_;
-        hclg_ = NULL;
         delete decoder_;
         decoder_ = NULL;
-        delete trans_model_;
-        trans_model_ = NULL;
-        delete am_nnet2_;
-        am_nnet2_ = NULL;
-        delete am_nnet3_;
-        am_nnet3_ = NULL;
-        delete am_gmm_;
-        am_gmm_ = NULL;
-        delete words_;
-        words_ = NULL;
-        delete config_;
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            delete extra_decoders_[i];
+        }
+        extra_decoders_.clear();
+        delete keyword_decoder_;
+        keyword_decoder_ = NULL;
+        delete composed_hclg_;
+        composed_hclg_ = NULL;
+        hclg_ = NULL;
+        delete g_classes_;
+        g_classes_ = NULL;
+        for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                it != class_fsts_.end(); ++it) {
+            delete it->second;
+        }
+        class_fsts_.clear();
+        delete session_;
+        session_ = NULL;
+        delete adaptation_state_;
+        adaptation_state_ = NULL;
+        delete session_log_;
+        session_log_ = NULL;
+        // The model goes last; everything above refers to it.
+        model_->Unref();
+        model_ = NULL;
         config_ = NULL;
-        delete decodable_;
-        decodable_ = NULL;
-        delete word_boundary_info_;
-        word_boundary_info_ = NULL;
     }
 
+    void Decoder::Init() {
+        config_ = model_->config;
+        session_ = new SessionConfig(config_);
+        BuildGraph();
+        Reset();
 
-    void Decoder::ParseConfig() {
-        KALDI_PARANOID_ASSERT(config_ == NULL);
+        KALDI_VLOG(2) << "Decoder is successfully initialized.";
+    }
 
-        config_ = new DecoderConfig();
+    void Decoder::SwitchModel(DecoderModel *model) {
+        KALDI_LOG << "Decoder is switching to the models in " << model->Path();
 
-        string cfg_name;
-        if(FileExists("pykaldi.cfg")) {
-            cfg_name = "pykaldi.cfg";
-            KALDI_WARN << "Using deprecated configuration file. Please move pykaldi.cfg to alex_asr.conf.";
-        } else if(FileExists("alex_asr.conf")) {
-            cfg_name = "alex_asr.conf";
-        } else {
-            KALDI_ERR << "AlexASR Decoder configuration (alex_asr.conf) not found in model directory."
-                    "Please check your configuration.";
+        // Everything built on top of the old model goes with it.
+        delete decodable_;
+        decodable_ = NULL;
+        chunked_decodable_ = NULL;
+        delete feature_pipeline_;
+        feature_pipeline_ = NULL;
+        delete adaptation_state_;
+        adaptation_state_ = NULL;
+        if(!class_fsts_.empty()) {
+            KALDI_WARN << "Dropping the class phrases; set them again for the new model.";
+            for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                    it != class_fsts_.end(); ++it) {
+                delete it->second;
+            }
+            class_fsts_.clear();
         }
 
-        config_->LoadConfigs(cfg_name);
+        SessionConfig *old_session = session_;
+        session_ = NULL;
+        model_->Unref();
+        model_ = model;
+        config_ = model_->config;
+
+        // Keep the input format and the speaker of the session.
+        session_ = new SessionConfig(config_);
+        session_->bits_per_sample = old_session->bits_per_sample;
+        session_->input_samp_freq = old_session->input_samp_freq;
+        if(old_session->spkrID != session_->spkrID) {
+            try {
+                session_->ChangeSpkrID(old_session->spkrID);
+            } catch(const std::exception &) {
+                KALDI_WARN << "Speaker " << old_session->spkrID << " is not available with the new model.";
+                session_->ChangeSpkrID(config_->spkrID);
+            }
+        }
+        delete old_session;
 
-        if(!config_->InitAndCheck()) {
-            KALDI_ERR << "Error when checking if the configuration is valid. "
-                    "Please check your configuration.";
+        if(!config_->enable_checkpoint) {
+            delete session_log_;
+            session_log_ = NULL;
         }
+
+        BuildGraph();
     }
 
-    bool Decoder::FileExists(const std::string& name) {
-        struct stat buffer;
-        return (stat (name.c_str(), &buffer) == 0);
+    void Decoder::Reset(bool keep_adaptation) {
+        // Pick up the model reloaded by the manager since the last utterance.
+        // The adaptation state was estimated for the old features and is
+        // dropped.
+        if(manager_ != NULL) {
+            DecoderModel *model = manager_->AcquireModel();
+            if(model != model_) {
+                if(keep_adaptation) {
+                    KALDI_WARN << "The model changed; the adaptation state is not kept.";
+                    keep_adaptation = false;
+                }
+                SwitchModel(model);
+            } else {
+                model->Unref();
+            }
+        }
+
+        // Either carry the speaker adaptation of the finished utterance over
+        // to the next one, or start from the global statistics again.
+        if(keep_adaptation) {
+            if(feature_pipeline_ != NULL) {
+                AdaptationState *adaptation_state = new AdaptationState();
+                feature_pipeline_->GetAdaptationState(adaptation_state);
+                delete adaptation_state_;
+                adaptation_state_ = adaptation_state;
+            }
+        } else {
+            delete adaptation_state_;
+            adaptation_state_ = NULL;
+        }
+
+        InitUtterance();
     }
 
-    void Decoder::LoadDecoder() {
-        bool binary;
-        Input ki(config_->model_rxfilename, &binary);
+    void Decoder::InitUtterance() {
+        delete decodable_;
+        decodable_ = NULL;
+        chunked_decodable_ = NULL;
+        delete feature_pipeline_;
+
+        feature_pipeline_ = new FeaturePipeline(*config_, *session_, adaptation_state_);
+        feature_start_frame_ = 0;
+        pipeline_audio_start_ = 0;
+        pipeline_audio_.clear();
+        input_finished_ = false;
+        num_input_samples_ = 0;
+        CreateDecodable();
+
+        // Undo the degradation of the previous utterance.
+        budget_status_ = SessionBudgetStatus();
+        SetSearchOptions(config_->decoder_opts);
+        decoder_->InitDecoding();
+        partial_words_.clear();
+        num_stable_words_ = 0;
+        endpoint_reported_ = false;
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->InitDecoding();
+        }
+        keyword_gated_ = false;
+        if(keyword_decoder_ != NULL) {
+            CloseKeywordGate(0);
+        }
 
-        KALDI_PARANOID_ASSERT(trans_model_ == NULL);
-        trans_model_ = new TransitionModel();
-        trans_model_->Read(ki.Stream(), binary);
+        if(config_->enable_checkpoint) {
+            std::ostringstream os;
+            if(adaptation_state_ != NULL) {
+                adaptation_state_->Write(os, true);
+            }
+            if(session_log_ == NULL) {
+                session_log_ = new SessionLog();
+            }
+            session_log_->Clear(os.str());
+        }
+    }
 
+    void Decoder::CreateDecodable() {
+        DecodableInterface *decodable = NULL;
+        chunked_decodable_ = NULL;
         if(config_->model_type == DecoderConfig::GMM) {
-            KALDI_PARANOID_ASSERT(am_gmm_ == NULL);
-            am_gmm_ = new AmDiagGmm();
-            am_gmm_->Read(ki.Stream(), binary);
+            decodable = new DecodableDiagGmmScaledOnline(*model_->am_gmm,
+                                                         *model_->trans_model,
+                                                         config_->decodable_opts.acoustic_scale,
+                                                         feature_pipeline_->GetFeature());
         } else if(config_->model_type == DecoderConfig::NNET2) {
-            KALDI_PARANOID_ASSERT(am_nnet2_ == NULL);
-            am_nnet2_ = new nnet2::AmNnet();
-            am_nnet2_->Read(ki.Stream(), binary);
+            decodable = new nnet2::DecodableNnet2Online(*model_->am_nnet2,
+                                                        *model_->trans_model,
+                                                        config_->decodable_opts,
+                                                        feature_pipeline_->GetFeature());
         } else if(config_->model_type == DecoderConfig::NNET3) {
-            KALDI_PARANOID_ASSERT(am_nnet3_ == NULL);
-            am_nnet3_ = new nnet3::AmNnetSimple();
-            am_nnet3_->Read(ki.Stream(), binary);
+            decodable = new kaldi::nnet3::DecodableNnet3SimpleOnline(*model_->am_nnet3,
+                                                                     *model_->trans_model,
+                                                                     config_->nnet3_decodable_opts,
+                                                                     feature_pipeline_->GetFeature());
+            if(config_->nnet3_frames_per_chunk > 0) {
+                chunked_decodable_ = new DecodableChunked(decodable, config_->nnet3_frames_per_chunk);
+                decodable = chunked_decodable_;
+            }
+        } else {
+            KALDI_ASSERT(false);  // This means the program is in invalid state.
+        }
+
+        if(feature_start_frame_ > 0) {
+            decodable_ = new DecodableFrameOffset(decodable, feature_start_frame_);
+        } else {
+            decodable_ = decodable;
         }
+    }
 
-        KALDI_PARANOID_ASSERT(hclg_ == NULL);
-        hclg_ = ReadDecodeGraph(config_->fst_rxfilename);
-        KALDI_PARANOID_ASSERT(decoder_ == NULL);
-        decoder_ = new LatticeFasterOnlineDecoder(*hclg_, config_->decoder_opts);
+    void Decoder::GetAdaptationState(string *state_out) {
+        AdaptationState adaptation_state;
+        feature_pipeline_->GetAdaptationState(&adaptation_state);
 
-        KALDI_PARANOID_ASSERT(words_ == NULL);
-        words_ = fst::SymbolTable::ReadText(config_->words_rxfilename);
+        std::ostringstream os;
+        adaptation_state.Write(os, true);
+        *state_out = os.str();
+    }
 
-        KALDI_PARANOID_ASSERT(word_boundary_info_ == NULL);
-        if(config_->word_boundary_rxfilename != "") {
-            WordBoundaryInfoNewOpts word_boundary_info_opts;
-            word_boundary_info_ = new WordBoundaryInfo(word_boundary_info_opts, config_->word_boundary_rxfilename);
+    void Decoder::SetAdaptationState(const string &state_in) {
+        AdaptationState *adaptation_state = new AdaptationState();
+        std::istringstream is(state_in);
+        try {
+            adaptation_state->Read(is, true, config_->ivector_extraction_info);
+        } catch(...) {
+            delete adaptation_state;
+            throw;
         }
+        delete adaptation_state_;
+        adaptation_state_ = adaptation_state;
+
+        // The adaptation state can only be applied to a fresh utterance.
+        InitUtterance();
     }
 
-    void Decoder::Reset() {
-        delete feature_pipeline_;
-        delete decodable_;
+    void Decoder::Checkpoint(string *checkpoint_out) {
+        if(session_log_ == NULL) {
+            KALDI_ERR << "Checkpointing is disabled; set --enable_checkpoint=true in the model configuration.";
+        }
 
-        feature_pipeline_ = new FeaturePipeline(*config_);
+        std::ostringstream os;
+        WriteToken(os, true, "<DecoderCheckpoint>");
+        // Fingerprint of the model, checked when restoring.
+        WriteBasicType(os, true, model_->trans_model->NumTransitionIds());
+        WriteBasicType(os, true, model_->trans_model->NumPdfs());
+        WriteBasicType(os, true, static_cast<int32>(hclg_->Start()));
+        // The phrases of SetClassPhrases(), which are part of the graph.
+        WriteToken(os, true, "<Classes>");
+        WriteBasicType(os, true, static_cast<int32>(class_fsts_.size()));
+        for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                it != class_fsts_.end(); ++it) {
+            WriteToken(os, true, model_->words->Find(it->first));
+            if(!it->second->Write(os, fst::FstWriteOptions("checkpoint"))) {
+                KALDI_ERR << "Could not write the class FST of " << model_->words->Find(it->first);
+            }
+        }
+        WriteToken(os, true, session_->spkrID == "" ? "None" : session_->spkrID);
+        WriteBasicType(os, true, session_->bits_per_sample);
+        WriteBasicType(os, true, static_cast<int32>(session_->InputSamplingFrequency()));
+        session_log_->Write(os, true);
+        WriteToken(os, true, "</DecoderCheckpoint>");
 
-        if(config_->model_type == DecoderConfig::GMM) {
-            decodable_ = new DecodableDiagGmmScaledOnline(*am_gmm_,
-                                                          *trans_model_,
-                                                          config_->decodable_opts.acoustic_scale,
-                                                          feature_pipeline_->GetFeature());
-        } else if(config_->model_type == DecoderConfig::NNET2) {
-            decodable_ = new nnet2::DecodableNnet2Online(*am_nnet2_,
-                                                         *trans_model_,
-                                                         config_->decodable_opts,
-                                                         feature_pipeline_->GetFeature());
-        } else if(config_->model_type == DecoderConfig::NNET3) {
-            decodable_ = new kaldi::nnet3::DecodableNnet3SimpleOnline(*am_nnet3_,
-                                                                      *trans_model_,
-                                                                      config_->nnet3_decodable_opts,
-                                                                      feature_pipeline_->GetFeature());
+        *checkpoint_out = os.str();
+    }
+
+    void Decoder::Restore(const string &checkpoint_in) {
+        if(session_log_ == NULL) {
+            KALDI_ERR << "Checkpointing is disabled; set --enable_checkpoint=true in the model configuration.";
+        }
+
+        std::istringstream is(checkpoint_in);
+        int32 num_transition_ids, num_pdfs, start_state, num_classes, bits_per_sample, input_samp_freq;
+        string spkr_id;
+        SessionLog session_log;
+        std::map<int32, fst::StdVectorFst *> class_fsts;
+
+        try {
+            ExpectToken(is, true, "<DecoderCheckpoint>");
+            ReadBasicType(is, true, &num_transition_ids);
+            ReadBasicType(is, true, &num_pdfs);
+            ReadBasicType(is, true, &start_state);
+            if(num_transition_ids != model_->trans_model->NumTransitionIds() ||
+                    num_pdfs != model_->trans_model->NumPdfs()) {
+                KALDI_ERR << "The checkpoint was created by a decoder with a different model.";
+            }
+            ExpectToken(is, true, "<Classes>");
+            ReadBasicType(is, true, &num_classes);
+            if(num_classes > 0 && model_->hcl == NULL) {
+                KALDI_ERR << "The checkpoint has class phrases, which need on-the-fly composition (--hcl and --g).";
+            }
+            for(int32 i = 0; i < num_classes; i++) {
+                string class_name;
+                ReadToken(is, true, &class_name);
+                int32 class_id = model_->words->Find(class_name);
+                if(class_id == fst::kNoSymbol) {
+                    KALDI_ERR << "Class " << class_name << " of the checkpoint is not in the word list.";
+                }
+                fst::StdVectorFst *class_fst = fst::StdVectorFst::Read(is, fst::FstReadOptions("checkpoint"));
+                if(class_fst == NULL) {
+                    KALDI_ERR << "Could not read the class FST of " << class_name << " from the checkpoint.";
+                }
+                delete class_fsts[class_id];
+                class_fsts[class_id] = class_fst;
+            }
+            ReadToken(is, true, &spkr_id);
+            ReadBasicType(is, true, &bits_per_sample);
+            ReadBasicType(is, true, &input_samp_freq);
+            session_log.Read(is, true);
+            ExpectToken(is, true, "</DecoderCheckpoint>");
+        } catch(...) {
+            for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts.begin();
+                    it != class_fsts.end(); ++it) {
+                delete it->second;
+            }
+            throw;
+        }
+
+        // The session decodes with the classes of the checkpoint, and with
+        // no others.
+        if(!class_fsts.empty() || !class_fsts_.empty()) {
+            for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                    it != class_fsts_.end(); ++it) {
+                delete it->second;
+            }
+            class_fsts_ = class_fsts;
+            BuildGraph();
+        }
+        if(start_state != hclg_->Start()) {
+            KALDI_ERR << "The checkpoint was created by a decoder with a different model.";
+        }
+
+        if(spkr_id != (session_->spkrID == "" ? "None" : session_->spkrID)) {
+            session_->ChangeSpkrID(spkr_id);
+        }
+        session_->bits_per_sample = bits_per_sample;
+        session_->input_samp_freq = input_samp_freq;
+
+        delete adaptation_state_;
+        adaptation_state_ = NULL;
+        if(session_log.AdaptationState() != "") {
+            adaptation_state_ = new AdaptationState();
+            std::istringstream state_is(session_log.AdaptationState());
+            adaptation_state_->Read(state_is, true, config_->ivector_extraction_info);
+        }
+        InitUtterance();
+
+        // Replay the utterance; this also records it into the new session log.
+        const std::vector<std::pair<int32, int32> > &events = session_log.Events();
+        int32 audio_offset = 0;
+        for(size_t i = 0; i < events.size(); i++) {
+            int32 value = events[i].second;
+            switch(events[i].first) {
+                case SessionLog::kAudio:
+                {
+                    Vector<BaseFloat> waveform;
+                    session_log.GetAudio(audio_offset, value, &waveform);
+                    audio_offset += value;
+                    this->FrameIn(&waveform);
+                    break;
+                }
+                case SessionLog::kDecode:
+                {
+                    int32 num_decoded = this->Decode(value);
+                    if(num_decoded != value) {
+                        KALDI_WARN << "Restored session decoded " << num_decoded
+                                   << " frames instead of " << value;
+                    }
+                    break;
+                }
+                case SessionLog::kInputFinished:
+                    this->InputFinished();
+                    break;
+                case SessionLog::kFinalize:
+                    this->FinalizeDecoding();
+                    break;
+                default:
+                    KALDI_ERR << "Unknown event in session log: " << events[i].first;
+            }
+        }
+    }
+
+    void Decoder::SetClassPhrases(const string &class_name, const std::vector<string> &phrases,
+                                  const std::vector<float> &costs) {
+        if(model_->hcl == NULL) {
+            KALDI_ERR << "Class FSTs can only be used with on-the-fly composition (--hcl and --g).";
+        }
+        if(!costs.empty() && costs.size() != phrases.size()) {
+            KALDI_ERR << "Got " << costs.size() << " costs for " << phrases.size() << " phrases.";
+        }
+
+        int32 class_id = model_->words->Find(class_name);
+        if(class_id == fst::kNoSymbol) {
+            KALDI_ERR << "Class " << class_name << " is not in the word list.";
+        }
+
+        std::vector<std::vector<int32> > phrase_ids(phrases.size());
+        for(size_t i = 0; i < phrases.size(); i++) {
+            std::vector<string> phrase_words;
+            SplitStringToVector(phrases[i], " \t", true, &phrase_words);
+            for(size_t j = 0; j < phrase_words.size(); j++) {
+                int32 word_id = model_->words->Find(phrase_words[j]);
+                if(word_id == fst::kNoSymbol) {
+                    KALDI_ERR << "Word " << phrase_words[j] << " of class " << class_name
+                              << " is not in the word list.";
+                }
+                phrase_ids[i].push_back(word_id);
+            }
+        }
+
+        std::vector<BaseFloat> phrase_costs(phrases.size(), 0.0);
+        for(size_t i = 0; i < costs.size(); i++) {
+            phrase_costs[i] = costs[i];
+        }
+
+        fst::StdVectorFst *class_fst = PhrasesToFst(phrase_ids, phrase_costs, model_->g_relabel_pairs);
+        delete class_fsts_[class_id];
+        class_fsts_[class_id] = class_fst;
+
+        BuildGraph();
+        InitUtterance();
+    }
+
+    void Decoder::ClearClasses() {
+        if(class_fsts_.empty()) {
+            return;
+        }
+
+        for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                it != class_fsts_.end(); ++it) {
+            delete it->second;
+        }
+        class_fsts_.clear();
+
+        BuildGraph();
+        InitUtterance();
+    }
+
+    void Decoder::BuildGraph() {
+        // Only the lazy views of the graph are rebuilt; the model is shared.
+        delete decoder_;
+        decoder_ = NULL;
+        if(finalize_worker_ != NULL) {
+            finalize_worker_->DropSearches();
+        }
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            delete extra_decoders_[i];
+        }
+        extra_decoders_.clear();
+        delete keyword_decoder_;
+        keyword_decoder_ = NULL;
+        delete composed_hclg_;
+        composed_hclg_ = NULL;
+        delete g_classes_;
+        g_classes_ = NULL;
+
+        size_t cache_size = static_cast<size_t>(config_->compose_cache_mb) << 20;
+        if(model_->hclg != NULL) {
+            hclg_ = model_->hclg;
+        } else if(class_fsts_.empty()) {
+            hclg_ = composed_hclg_ = ComposeGraph(*model_->hcl, *model_->g, cache_size);
         } else {
-            KALDI_ASSERT(false);  // This means the program is in invalid state.
+            std::vector<std::pair<int32, const fst::StdFst *> > classes;
+            for(std::map<int32, fst::StdVectorFst *>::iterator it = class_fsts_.begin();
+                    it != class_fsts_.end(); ++it) {
+                classes.push_back(std::make_pair(it->first, static_cast<const fst::StdFst *>(it->second)));
+            }
+            g_classes_ = ReplaceClasses(*model_->g, classes, cache_size);
+            hclg_ = composed_hclg_ = ComposeGraph(*model_->hcl, *g_classes_, cache_size);
+        }
+        decoder_ = new LatticeFasterOnlineDecoder(*hclg_, config_->decoder_opts, config_->pool_opts);
+        for(size_t i = 0; i < model_->extra_hclgs.size(); i++) {
+            extra_decoders_.push_back(new LatticeFasterOnlineDecoder(*model_->extra_hclgs[i],
+                                                                     config_->decoder_opts,
+                                                                     config_->pool_opts));
         }
+        if(model_->keyword_hclg != NULL) {
+            keyword_decoder_ = new LatticeFasterOnlineDecoder(*model_->keyword_hclg, config_->decoder_opts,
+                                                              config_->pool_opts);
+        }
+    }
 
-        decoder_->InitDecoding();
+    LatticeFasterOnlineDecoder *Decoder::Search(int32 graph) {
+        if(graph == 0) {
+            return decoder_;
+        } else if(graph > 0 && graph <= static_cast<int32>(extra_decoders_.size())) {
+            return extra_decoders_[graph - 1];
+        } else {
+            KALDI_ERR << "Invalid graph index " << graph << "; the decoder has "
+                      << extra_decoders_.size() + 1 << " graphs.";
+            return NULL;
+        }
+    }
+
+    std::vector<string> Decoder::GetGraphNames() {
+        std::vector<string> names(1, "main");
+        for(size_t i = 0; i < config_->extra_graphs.size(); i++) {
+            names.push_back(config_->extra_graphs[i].first);
+        }
+        return names;
     }
 
     bool Decoder::EndpointDetected() {
-        return kaldi::EndpointDetected(config_->endpoint_config, *trans_model_,
-                                       config_->FrameShiftInSeconds(),
-                                       *decoder_);
+        if(budget_status_.endpoint_forced) {
+            return true;
+        }
+        if(keyword_gated_) {
+            return false;
+        }
+        return alex_asr::EndpointDetected(config_->endpoint_config, *model_->trans_model,
+                                          config_->FrameShiftInSeconds(),
+                                          *decoder_);
     }
 
     void Decoder::FrameIn(VectorBase<BaseFloat> *waveform_in) {
-        feature_pipeline_->AcceptWaveform(config_->SamplingFrequency(), *waveform_in);
+        if(budget_status_.endpoint_forced && !config_->auto_segment) {
+            return;  // The rest of the utterance is ignored.
+        }
+        feature_pipeline_->AcceptWaveform(session_->InputSamplingFrequency(), *waveform_in);
+        if(session_log_) {
+            session_log_->AddAudio(*waveform_in);
+        }
+        if(config_->long_audio_commit_secs > 0.0 || keyword_decoder_ != NULL) {
+            pipeline_audio_.insert(pipeline_audio_.end(), waveform_in->Data(),
+                                   waveform_in->Data() + waveform_in->Dim());
+        }
+
+        // The frames are counted from the audio: the NumFramesReady() of the
+        // decodable would wait for the worker of --async_pitch and
+        // --async_base_feature to catch up.
+        num_input_samples_ += waveform_in->Dim();
+        int32 max_frames = config_->budget_opts.max_frames;
+        if(max_frames > 0 && !keyword_gated_) {
+            double num_secs = static_cast<double>(num_input_samples_) / session_->InputSamplingFrequency();
+            int32 num_frames = static_cast<int32>(num_secs / config_->FrameShiftInSeconds())
+                               - decoder_->StartFrame();
+            if(num_frames > max_frames) {
+                std::ostringstream reason;
+                reason << num_frames << " feature frames (limit " << max_frames << ")";
+                ForceEndpoint(reason.str());
+            }
+        }
     }
 
     void Decoder::FrameIn(unsigned char *buffer, int32 buffer_length) {
-        int n_frames = buffer_length / (config_->bits_per_sample / 8);
+        int n_frames = buffer_length / (session_->bits_per_sample / 8);
 
         Vector<BaseFloat> waveform(n_frames);
 
         for(int32 i = 0; i < n_frames; ++i) {
-            switch(config_->bits_per_sample) {
+            switch(session_->bits_per_sample) {
                 case 8:
                 {
                     waveform(i) = (*buffer);
@@ -189,7 +633,7 @@ namespace alex_asr {
                 }
                 default:
                     KALDI_ERR << "Unsupported bits ber sample (implement yourself): "
-                    << config_->bits_per_sample;
+                    << session_->bits_per_sample;
             }
         }
         this->FrameIn(&waveform);
@@ -197,24 +641,464 @@ namespace alex_asr {
 
     void Decoder::InputFinished() {
         feature_pipeline_->InputFinished();
+        input_finished_ = true;
+        if(chunked_decodable_ != NULL) {
+            chunked_decodable_->InputFinished();
+        }
+        if(session_log_) {
+            session_log_->AddEvent(SessionLog::kInputFinished, 0);
+        }
     }
 
     int32 Decoder::Decode(int32 max_frames) {
+        if(keyword_gated_) {
+            // The main search starts at the next call if a keyword is found.
+            return DecodeKeywords(max_frames);
+        }
+
         int32 decoded = decoder_->NumFramesDecoded();
-        decoder_->AdvanceDecoding(decodable_, max_frames);
+        if(!config_->budget_opts.Enabled() && !config_->auto_segment) {
+            AdvanceSearches(max_frames);
+        } else {
+            // Check the budgets and the endpoints every few frames, so that no
+            // single call can overrun a budget or a segment by much. After a
+            // forced endpoint no more audio is accepted (unless segmenting),
+            // so only the frames already buffered are decoded.
+            const int32 kCheckFrames = 10;
+            while(max_frames < 0 || decoder_->NumFramesDecoded() - decoded < max_frames) {
+                int32 num_frames = kCheckFrames;
+                if(max_frames >= 0) {
+                    num_frames = std::min(num_frames, max_frames - (decoder_->NumFramesDecoded() - decoded));
+                }
+                if(AdvanceSearches(num_frames) == 0) {
+                    break;
+                }
+                if(config_->budget_opts.Enabled()) {
+                    CheckBudgets();
+                }
+                if(config_->auto_segment && EndpointDetected()) {
+                    EndSegment();
+                    if(keyword_gated_) {
+                        break;  // The rest waits for the next keyword.
+                    }
+                }
+            }
+        }
 
+        int32 num_decoded = decoder_->NumFramesDecoded() - decoded;
+        if(session_log_ && num_decoded > 0) {
+            session_log_->AddEvent(SessionLog::kDecode, num_decoded);
+        }
+        if(listener_ != NULL && num_decoded > 0 && NumFramesDecoded() > 0 && !keyword_gated_) {
+            NotifyListener();
+        }
+        if(config_->long_audio_commit_secs > 0.0 && !input_finished_) {
+            CommitLongAudio();
+        }
+        return num_decoded;
+    }
+
+    void Decoder::EndSegment() {
+        if(listener_ != NULL) {
+            NotifyListener();  // Reports the endpoint.
+        }
+        decoder_->FinalizeDecoding();
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->FinalizeDecoding();
+        }
+        if(listener_ != NULL) {
+            NotifyListener(true);
+        }
+
+        std::vector<int> ali_words, ali_times, ali_lengths;
+        std::vector<int32> words, times, lengths;
+        GetTimeAlignment(&ali_words, &ali_times, &ali_lengths);
+        for(size_t i = 0; i < ali_words.size(); i++) {
+            if(ali_words[i] != 0) {
+                words.push_back(ali_words[i]);
+                times.push_back(ali_times[i]);
+                lengths.push_back(ali_lengths[i]);
+            }
+        }
+        if(listener_ != NULL) {
+            listener_->OnSegment(words, times, lengths);
+        } else {
+            committed_words_.insert(committed_words_.end(), words.begin(), words.end());
+            committed_times_.insert(committed_times_.end(), times.begin(), times.end());
+            committed_lengths_.insert(committed_lengths_.end(), lengths.begin(), lengths.end());
+        }
+        KALDI_VLOG(2) << "Segment ended at frame " << decoder_->NumFramesDecoded();
+
+        // The next segment goes on with the same features and adaptation;
+        // only the searches start again.
+        int32 frame = decoder_->NumFramesDecoded();
+        budget_status_ = SessionBudgetStatus();
+        SetSearchOptions(config_->decoder_opts);
+        decoder_->InitDecoding(frame);
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->InitDecoding(frame);
+        }
+        partial_words_.clear();
+        num_stable_words_ = 0;
+        endpoint_reported_ = false;
+        if(keyword_decoder_ != NULL) {
+            CloseKeywordGate(frame);
+        }
+    }
+
+    void Decoder::CloseKeywordGate(int32 frame) {
+        keyword_gated_ = true;
+        keyword_gate_frame_ = frame;
+        keyword_decoder_->InitDecoding(frame);
+    }
+
+    int32 Decoder::DecodeKeywords(int32 max_frames) {
+        int32 decoded = keyword_decoder_->NumFramesDecoded();
+        keyword_decoder_->AdvanceDecoding(decodable_, max_frames);
+        int32 num_decoded = keyword_decoder_->NumFramesDecoded() - decoded;
+        if(num_decoded == 0) {
+            return 0;
+        }
+
+        BaseFloat frame_shift = config_->FrameShiftInSeconds();
+        int32 keyword;
+        int32 keyword_frame = FindKeyword(&keyword);
+        if(keyword_frame >= 0) {
+            // The main search starts a bit before the keyword, on the frames
+            // still kept by the feature pipeline.
+            int32 preroll = static_cast<int32>(config_->keyword_preroll_secs / frame_shift);
+            int32 start_frame = std::max(keyword_frame - preroll, std::max(keyword_gate_frame_, feature_start_frame_));
+            keyword_gated_ = false;
+            decoder_->InitDecoding(start_frame);
+            for(size_t i = 0; i < extra_decoders_.size(); i++) {
+                extra_decoders_[i]->InitDecoding(start_frame);
+            }
+            KALDI_VLOG(2) << "Keyword " << model_->words->Find(keyword) << " found at frame " << keyword_frame
+                          << "; the main search starts at frame " << start_frame;
+            if(listener_ != NULL) {
+                listener_->OnKeyword(keyword);
+            }
+            return num_decoded;
+        }
+
+        // Without a keyword, the search and the features of the last window
+        // are dropped, keeping an overlap long enough for a keyword in
+        // progress and its preroll.
+        const BaseFloat kOverlapSecs = 2.0;
+        int32 window = std::max(1, static_cast<int32>(config_->keyword_window_secs / frame_shift));
+        int32 overlap = std::min(static_cast<int32>(kOverlapSecs / frame_shift), window / 2);
+        int32 frame = keyword_decoder_->NumFramesDecoded();
+        if(!input_finished_ && frame - keyword_decoder_->StartFrame() >= window) {
+            keyword_decoder_->InitDecoding(frame - overlap);
+            int32 preroll = static_cast<int32>(config_->keyword_preroll_secs / frame_shift);
+            RestartFeaturePipeline(frame - overlap - preroll);
+        }
+        return num_decoded;
+    }
+
+    int32 Decoder::FindKeyword(int32 *keyword) {
+        std::vector<int32> words;
+        int32 num_stable;
+        keyword_decoder_->GetPartialResult(&words, &num_stable);
+        // Only stable words count, unless no more frames will come.
+        int32 num_checked = num_stable;
+        if(input_finished_ && keyword_decoder_->NumFramesDecoded() == decodable_->NumFramesReady()) {
+            num_checked = words.size();
+        }
+
+        int32 index = -1;
+        for(int32 i = 0; i < num_checked && index < 0; i++) {
+            if(std::find(model_->keyword_ids.begin(), model_->keyword_ids.end(), words[i]) !=
+                    model_->keyword_ids.end()) {
+                index = i;
+            }
+        }
+        if(index < 0) {
+            return -1;
+        }
+        *keyword = words[index];
+
+        // The start of the keyword on the best path; the graph's word labels
+        // are near the word starts, the preroll covers the rest.
+        Lattice best_path;
+        CompactLattice compact_best_path;
+        std::vector<int32> ali_words, ali_times, ali_lengths;
+        keyword_decoder_->GetBestPath(&best_path, false);
+        ConvertLattice(best_path, &compact_best_path);
+        CompactLatticeToWordAlignment(compact_best_path, &ali_words, &ali_times, &ali_lengths);
+        int32 num_words = 0;
+        for(size_t i = 0; i < ali_words.size(); i++) {
+            if(ali_words[i] != 0 && num_words++ == index) {
+                return ali_times[i] + keyword_decoder_->FrameOffset();
+            }
+        }
+        return keyword_decoder_->StartFrame();
+    }
+
+    void Decoder::CommitLongAudio() {
+        int32 commit_frames = std::max(1, static_cast<int32>(config_->long_audio_commit_secs /
+                                                             config_->FrameShiftInSeconds()));
+        if(decoder_->NumFramesDecoded() - decoder_->FrameOffset() >= commit_frames) {
+            std::vector<int32> words;
+            int32 num_stable;
+            LatticeFasterOnlineDecoder::BestPathIterator point = decoder_->GetStablePoint(&words, &num_stable);
+
+            // Align the stable words while the whole best path is there.
+            std::vector<int32> times, lengths;
+            if(num_stable > 0) {
+                Lattice best_path;
+                CompactLattice compact_best_path, aligned_best_path;
+                std::vector<int32> ali_words, ali_times, ali_lengths;
+                decoder_->GetBestPath(&best_path, false);
+                ConvertLattice(best_path, &compact_best_path);
+                // The last word of a partial path usually cannot be aligned
+                // to word boundaries; fall back to the unaligned path then.
+                bool ok = config_->word_boundary_rxfilename != "" &&
+                        WordAlignLattice(compact_best_path, *model_->trans_model, *model_->word_boundary_info,
+                                         0, &aligned_best_path) &&
+                        CompactLatticeToWordAlignment(aligned_best_path, &ali_words, &ali_times, &ali_lengths);
+                if(!ok) {
+                    CompactLatticeToWordAlignment(compact_best_path, &ali_words, &ali_times, &ali_lengths);
+                }
+                for(size_t i = 0; i < ali_words.size() && static_cast<int32>(times.size()) < num_stable; i++) {
+                    if(ali_words[i] != 0) {
+                        times.push_back(ali_times[i] + decoder_->FrameOffset());
+                        lengths.push_back(ali_lengths[i]);
+                    }
+                }
+                // Words the alignment missed get no time.
+                times.resize(num_stable, -1);
+                lengths.resize(num_stable, 0);
+            }
+            words.resize(num_stable);
+
+            if(!point.Done() && point.frame >= 0) {
+                decoder_->DiscardHistory(point);
+                int32 num_committed = words.size();
+                if(num_committed > 0) {
+                    if(listener_ != NULL) {
+                        listener_->OnCommit(words, times, lengths);
+                    } else {
+                        committed_words_.insert(committed_words_.end(), words.begin(), words.end());
+                        committed_times_.insert(committed_times_.end(), times.begin(), times.end());
+                        committed_lengths_.insert(committed_lengths_.end(), lengths.begin(), lengths.end());
+                    }
+                }
+                // The listener is told about the words after the commit only.
+                partial_words_.erase(partial_words_.begin(),
+                                     partial_words_.begin() + std::min<size_t>(num_committed, partial_words_.size()));
+                num_stable_words_ = std::max(0, num_stable_words_ - num_committed);
+            }
+        }
+
+        if(decoder_->NumFramesDecoded() - feature_start_frame_ >= commit_frames) {
+            RestartFeaturePipeline(decoder_->NumFramesDecoded());
+        }
+    }
+
+    void Decoder::RestartFeaturePipeline(int32 first_frame) {
+        // Audio before the first frame still needed that is fed to the new
+        // pipeline again, as the left context of the acoustic model.
+        const BaseFloat kContextSecs = 1.0;
+        BaseFloat frame_shift = config_->FrameShiftInSeconds();
+        int32 start_frame = first_frame - static_cast<int32>(kContextSecs / frame_shift);
+        if(start_frame <= feature_start_frame_) {
+            return;
+        }
+        BaseFloat samp_freq = session_->InputSamplingFrequency();
+        int64 start_sample = static_cast<int64>(start_frame * frame_shift * samp_freq + 0.5);
+        KALDI_ASSERT(start_sample >= pipeline_audio_start_);
+        if(start_sample - pipeline_audio_start_ > static_cast<int64>(pipeline_audio_.size())) {
+            return;  // The audio was not kept; cannot happen unless frames are decoded ahead of it.
+        }
+
+        AdaptationState adaptation_state;
+        feature_pipeline_->GetAdaptationState(&adaptation_state);
+        delete decodable_;
+        decodable_ = NULL;
+        chunked_decodable_ = NULL;
+        delete feature_pipeline_;
+        feature_pipeline_ = new FeaturePipeline(*config_, *session_, &adaptation_state);
+        feature_start_frame_ = start_frame;
+        CreateDecodable();
+
+        pipeline_audio_.erase(pipeline_audio_.begin(),
+                              pipeline_audio_.begin() + (start_sample - pipeline_audio_start_));
+        pipeline_audio_start_ = start_sample;
+        if(!pipeline_audio_.empty()) {
+            SubVector<BaseFloat> audio(&pipeline_audio_[0], pipeline_audio_.size());
+            feature_pipeline_->AcceptWaveform(samp_freq, audio);
+        }
+        KALDI_VLOG(2) << "Restarted the feature pipeline at frame " << start_frame;
+    }
+
+    void Decoder::GetCommittedResult(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths) {
+        words->clear();
+        times->clear();
+        lengths->clear();
+        words->swap(committed_words_);
+        times->swap(committed_times_);
+        lengths->swap(committed_lengths_);
+    }
+
+    int32 Decoder::AdvanceSearches(int32 max_frames) {
+        int32 decoded = decoder_->NumFramesDecoded();
+        if(extra_decoders_.empty()) {
+            decoder_->AdvanceDecoding(decodable_, max_frames);
+        } else {
+            // The searches advance frame by frame in lockstep, so that each
+            // frame's log-likelihoods are computed once and then served from
+            // the decodable's cache to the other graphs.
+            while(max_frames < 0 || decoder_->NumFramesDecoded() - decoded < max_frames) {
+                int32 num_frames = decoder_->NumFramesDecoded();
+                decoder_->AdvanceDecoding(decodable_, 1);
+                if(decoder_->NumFramesDecoded() == num_frames) {
+                    break;
+                }
+                for(size_t i = 0; i < extra_decoders_.size(); i++) {
+                    extra_decoders_[i]->AdvanceDecoding(decodable_, 1);
+                }
+            }
+        }
         return decoder_->NumFramesDecoded() - decoded;
     }
 
+    void Decoder::CheckBudgets() {
+        const SessionBudgetOptions &opts = config_->budget_opts;
+
+        DecoderPoolStats stats;
+        int64 num_tokens = 0, num_links = 0;
+        decoder_->GetPoolStats(&stats);
+        num_tokens += stats.tokens_used;
+        num_links += stats.links_used;
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->GetPoolStats(&stats);
+            num_tokens += stats.tokens_used;
+            num_links += stats.links_used;
+        }
+
+        if(opts.max_tokens > 0 && num_tokens > opts.max_tokens && !budget_status_.beam_tightened) {
+            KALDI_WARN << "The utterance keeps " << num_tokens << " search tokens (limit "
+                       << opts.max_tokens << "); tightening the beams.";
+            budget_status_.beam_tightened = true;
+            LatticeFasterDecoderConfig decoder_opts = decoder_->GetOptions();
+            decoder_opts.beam *= opts.beam_factor;
+            decoder_opts.lattice_beam *= opts.beam_factor;
+            SetSearchOptions(decoder_opts);
+        }
+        if(opts.max_lattice_arcs > 0 && num_links > opts.max_lattice_arcs && !budget_status_.best_path_only) {
+            KALDI_WARN << "The utterance keeps " << num_links << " lattice links (limit "
+                       << opts.max_lattice_arcs << "); keeping the best path only.";
+            budget_status_.best_path_only = true;
+            // Prunes away nearly all links off the best path.
+            LatticeFasterDecoderConfig decoder_opts = decoder_->GetOptions();
+            decoder_opts.lattice_beam = std::min(decoder_opts.lattice_beam, static_cast<BaseFloat>(0.01));
+            SetSearchOptions(decoder_opts);
+        }
+        if(opts.max_tokens > 0 && num_tokens > 2 * static_cast<int64>(opts.max_tokens)) {
+            std::ostringstream reason;
+            reason << num_tokens << " search tokens (limit " << opts.max_tokens << ")";
+            ForceEndpoint(reason.str());
+        }
+    }
+
+    void Decoder::ForceEndpoint(const string &reason) {
+        if(budget_status_.endpoint_forced) {
+            return;
+        }
+        KALDI_WARN << "The utterance has " << reason << "; forcing an endpoint.";
+        budget_status_.endpoint_forced = true;
+    }
+
+    void Decoder::SetSearchOptions(const LatticeFasterDecoderConfig &decoder_opts) {
+        decoder_->SetOptions(decoder_opts);
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->SetOptions(decoder_opts);
+        }
+    }
+
+    void Decoder::GetBudgetStatus(SessionBudgetStatus *status) {
+        *status = budget_status_;
+    }
+
     void Decoder::FinalizeDecoding() {
         decoder_->FinalizeDecoding();
+        for(size_t i = 0; i < extra_decoders_.size(); i++) {
+            extra_decoders_[i]->FinalizeDecoding();
+        }
+        if(session_log_) {
+            session_log_->AddEvent(SessionLog::kFinalize, 0);
+        }
+        if(listener_ != NULL && NumFramesDecoded() > 0) {
+            NotifyListener(true);
+        }
+    }
+
+    FinalResult *Decoder::FinalizeDecodingAsync(bool keep_adaptation) {
+        // The final costs need the graph, whose lazy composition must not be
+        // expanded from two threads, so only the work on the finalized
+        // search (which does not touch the graph any more) goes to the worker.
+        FinalizeDecoding();
+
+        FinalResult *result = new FinalResult(model_, decoder_, budget_status_.best_path_only);
+        decoder_ = NULL;
+        if(finalize_worker_ == NULL) {
+            try {
+                finalize_worker_ = new FinalizeWorker();
+            } catch(const std::exception &) {
+                KALDI_WARN << "Could not start the finalization thread; finalizing on this one.";
+            }
+        }
+        // The next utterance goes on with the pools of an earlier one, as it
+        // would with FinalizeDecoding(); Reset() starts the search again.
+        if(finalize_worker_ != NULL) {
+            finalize_worker_->Push(result);
+            decoder_ = finalize_worker_->TakeSearch();
+        } else {
+            result->Compute();
+            decoder_ = result->ReleaseSearch();
+        }
+        if(decoder_ == NULL) {
+            decoder_ = new LatticeFasterOnlineDecoder(*hclg_, config_->decoder_opts, config_->pool_opts);
+        }
+
+        Reset(keep_adaptation);
+        return result;
+    }
+
+    void Decoder::SetListener(DecoderListener *listener) {
+        listener_ = listener;
+    }
+
+    void Decoder::NotifyListener(bool finalized) {
+        std::vector<int32> words;
+        int32 num_stable;
+        decoder_->GetPartialResult(&words, &num_stable);
+
+        if(words != partial_words_) {
+            partial_words_ = words;
+            listener_->OnPartialResult(words);
+        }
+        if(num_stable > num_stable_words_) {
+            num_stable_words_ = num_stable;
+            listener_->OnStablePrefix(std::vector<int32>(words.begin(), words.begin() + num_stable));
+        }
+        // The endpoint rules need the unfinalized search.
+        if(!endpoint_reported_ && (budget_status_.endpoint_forced ||
+                (!finalized && config_->endpoint_config.silence_phones != "" && EndpointDetected()))) {
+            endpoint_reported_ = true;
+            listener_->OnEndpoint();
+        }
     }
 
-    bool Decoder::GetBestPath(std::vector<int> *out_words, BaseFloat *prob) {
+    bool Decoder::GetBestPath(std::vector<int> *out_words, BaseFloat *prob, int32 graph) {
         *prob = -1.0f;
 
         Lattice lat;
-        bool ok = decoder_->GetBestPath(&lat);
+        if(!Search(graph)->GetBestPath(&lat)) {
+            out_words->clear();
+            return false;
+        }
 
         LatticeWeight weight;
         std::vector<int32> ids;
@@ -225,88 +1109,113 @@ namespace alex_asr {
 
         *prob = weight.Value1() + weight.Value2();
 
-        return ok;
+        return true;
     }
 
-    bool Decoder::GetLattice(fst::VectorFst<fst::LogArc> *fst_out,
-                                     double *tot_lik, bool end_of_utterance) {
-        CompactLattice lat;
-        Lattice raw_lat;
+    bool Decoder::GetDeterminizedLattice(CompactLattice *clat, bool end_of_utterance, int32 graph) {
+        LatticeFasterOnlineDecoder *search = Search(graph);
 
-        if (decoder_->NumFramesDecoded() == 0)
+        if (search->NumFramesDecoded() == search->StartFrame())
             KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
 
         if (!config_->decoder_opts.determinize_lattice)
             KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
 
-        bool ok = decoder_->GetRawLattice(&raw_lat, end_of_utterance);
+        // The rescoring LM replaces the LM of the main graph only.
+        return GetSearchResults(*model_, search, budget_status_.best_path_only, end_of_utterance, graph == 0,
+                                clat, NULL, NULL, NULL, NULL, NULL);
+    }
+
+    bool Decoder::GetLattice(fst::VectorFst<fst::LogArc> *fst_out,
+                                     double *tot_lik, bool end_of_utterance, int32 graph) {
+        CompactLattice lat;
 
-        BaseFloat lat_beam = config_->decoder_opts.lattice_beam;
-        DeterminizeLatticePhonePrunedWrapper(
-                *trans_model_, &raw_lat, lat_beam, &lat, config_->decoder_opts.det_opts);
+        bool ok = GetDeterminizedLattice(&lat, end_of_utterance, graph);
 
-        *tot_lik = CompactLatticeToWordsPost(lat, fst_out);
+        *tot_lik = CompactLatticeToWordsPost(lat, fst_out, config_->post_opts);
 
         return ok;
     }
 
-    bool Decoder::GetTimeAlignment(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths) {
-        Lattice lat;
-        CompactLattice compact_lat;
-        CompactLattice best_path;
-        CompactLattice aligned_best_path;
-        bool ok = true;
+    bool Decoder::GetLatticeBuffer(std::vector<char> *buffer, bool with_alignments, bool end_of_utterance,
+                                   int32 graph) {
+        CompactLattice lat;
 
-        ok = ok && decoder_->GetRawLattice(&lat);
-        BaseFloat lat_beam = config_->decoder_opts.lattice_beam;
-        DeterminizeLatticePhonePrunedWrapper(*trans_model_, &lat, lat_beam, &compact_lat, config_->decoder_opts.det_opts);
-        CompactLatticeShortestPath(compact_lat, &best_path);
+        bool ok = GetDeterminizedLattice(&lat, end_of_utterance, graph);
 
-        if(config_->word_boundary_rxfilename == "") {
-            ok = ok && CompactLatticeToWordAlignment(best_path, words, times, lengths);
+        if(with_alignments) {
+            CompactLatticeToFlatLattice(lat, buffer);
         } else {
-            ok = ok && WordAlignLattice(best_path, *trans_model_, *word_boundary_info_, 0, &aligned_best_path);
-            ok = ok && CompactLatticeToWordAlignment(aligned_best_path, words, times, lengths);
+            fst::VectorFst<fst::LogArc> post_lat;
+            double tot_lik = CompactLatticeToWordsPost(lat, &post_lat, config_->post_opts);
+            WordsPostToFlatLattice(post_lat, tot_lik, buffer);
         }
 
         return ok;
     }
 
-    bool Decoder::GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths, std::vector<float> *confs) {
-        Lattice lat;
+    bool Decoder::GetTimeAlignment(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths,
+                                   int32 graph) {
         CompactLattice compact_lat;
-        CompactLattice best_path;
-        CompactLattice aligned_best_path;
-        bool ok = true;
+        return GetSearchResults(*model_, Search(graph), budget_status_.best_path_only, true, graph == 0,
+                                &compact_lat, NULL, words, times, lengths, NULL);
+    }
 
-        ok = ok && decoder_->GetRawLattice(&lat);
-        BaseFloat lat_beam = config_->decoder_opts.lattice_beam;
-        DeterminizeLatticePhonePrunedWrapper(*trans_model_, &lat, lat_beam, &compact_lat, config_->decoder_opts.det_opts);
-        CompactLatticeShortestPath(compact_lat, &best_path);
+    bool Decoder::GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths, std::vector<float> *confs,
+                                                     int32 graph) {
+        CompactLattice compact_lat;
+        return GetSearchResults(*model_, Search(graph), budget_status_.best_path_only, true, graph == 0,
+                                &compact_lat, NULL, words, times, lengths, confs);
+    }
 
-        if(config_->word_boundary_rxfilename != "") {
-            ok = ok && WordAlignLattice(best_path, *trans_model_, *word_boundary_info_, 0, &aligned_best_path);
-        } else {
-            aligned_best_path = best_path;
+    bool Decoder::GetConfusionNetwork(std::vector<std::vector<int> > *words,
+                                      std::vector<std::vector<float> > *posteriors,
+                                      std::vector<float> *begin_times,
+                                      std::vector<float> *end_times,
+                                      int32 graph) {
+        CompactLattice compact_lat;
+        bool ok = GetDeterminizedLattice(&compact_lat, true, graph);
+
+        // One pass over the lattice gives both the competing words and the
+        // confidences (the posterior of the best word of each bin).
+        MinimumBayesRisk mbr(compact_lat);
+        const std::vector<std::vector<std::pair<int32, BaseFloat> > > &stats = mbr.GetSausageStats();
+        const std::vector<std::pair<BaseFloat, BaseFloat> > &times = mbr.GetSausageTimes();
+        KALDI_ASSERT(stats.size() == times.size());
+
+        words->clear();
+        posteriors->clear();
+        begin_times->clear();
+        end_times->clear();
+        words->resize(stats.size());
+        posteriors->resize(stats.size());
+        BaseFloat frame_offset = Search(graph)->FrameOffset();
+        for(size_t i = 0; i < stats.size(); i++) {
+            for(size_t j = 0; j < stats[i].size(); j++) {
+                (*words)[i].push_back(stats[i][j].first);
+                (*posteriors)[i].push_back(stats[i][j].second);
+            }
+            begin_times->push_back(frame_offset + times[i].first);
+            end_times->push_back(frame_offset + times[i].second);
         }
 
-        ok = ok && CompactLatticeToWordAlignment(aligned_best_path, words, times, lengths);
-        MinimumBayesRisk *mbr = new MinimumBayesRisk(compact_lat, *words, true);
-        *confs = mbr->GetOneBestConfidences();
-
         return ok;
     }
 
     string Decoder::GetWord(int word_id) {
-        return words_->Find(word_id);
+        return model_->words->Find(word_id);
     }
 
-    float Decoder::FinalRelativeCost() {
-        return decoder_->FinalRelativeCost();
+    float Decoder::FinalRelativeCost(int32 graph) {
+        return Search(graph)->FinalRelativeCost();
     }
 
     int32 Decoder::NumFramesDecoded() {
-        return decoder_->NumFramesDecoded();
+        return decoder_->NumFramesDecoded() - decoder_->StartFrame();
+    }
+
+    bool Decoder::KeywordGated() {
+        return keyword_gated_;
     }
 
     int32 Decoder::TrailingSilenceLength() {
@@ -314,13 +1223,19 @@ namespace alex_asr {
             KALDI_WARN << "Trying to get training silence length for a model that does not have"
                           "silence phones configured.";
             return -1;
+        } else if(NumFramesDecoded() == 0) {
+            return 0;
         } else {
-            return kaldi::TrailingSilenceLength(*trans_model_,
-                                                config_->endpoint_config.silence_phones,
-                                                *decoder_);
+            return alex_asr::TrailingSilenceLength(*model_->trans_model,
+                                                   config_->endpoint_config.silence_phones,
+                                                   *decoder_);
         }
     }
 
+    void Decoder::GetPoolStats(DecoderPoolStats *stats) {
+        decoder_->GetPoolStats(stats);
+    }
+
     void Decoder::GetIvector(std::vector<float> *ivector) {
         if(config_->use_ivectors) {
             KALDI_WARN << "Trying to get an Ivector for a model that does not have Ivectors.";
@@ -329,7 +1244,7 @@ namespace alex_asr {
 
             Vector<BaseFloat> ivector_res;
             ivector_res.Resize(ivector_ftr->Dim());
-            ivector_ftr->GetFrame(decoder_->NumFramesDecoded() - 1, &ivector_res);
+            ivector_ftr->GetFrame(decoder_->NumFramesDecoded() - feature_start_frame_ - 1, &ivector_res);
 
             BaseFloat *data = ivector_res.Data();
             for (int32 i = 0; i < ivector_res.Dim(); i++) {
@@ -341,11 +1256,22 @@ namespace alex_asr {
     void Decoder::SetBitsPerSample(int n_bits) {
         KALDI_ASSERT(n_bits % 8 == 0);
 
-        config_->bits_per_sample = n_bits;
+        session_->bits_per_sample = n_bits;
     }
 
     int Decoder::GetBitsPerSample() {
-        return config_->bits_per_sample;
+        return session_->bits_per_sample;
+    }
+
+    void Decoder::SetInputSamplingFrequency(int32 samp_freq) {
+        KALDI_ASSERT(samp_freq > 0);
+
+        session_->input_samp_freq = samp_freq;
+        this->Reset();
+    }
+
+    int32 Decoder::GetInputSamplingFrequency() {
+        return static_cast<int32>(session_->InputSamplingFrequency());
     }
 
     float Decoder::GetFrameShift() {
@@ -353,15 +1279,64 @@ namespace alex_asr {
     }
 
     void Decoder::SetSpkrID(string spkr_ID) {
-        config_->ChangeSpkrID(spkr_ID);
+        session_->ChangeSpkrID(spkr_ID);
         this->Reset();
     }
 
     string Decoder::GetSpkrID() {
-        return config_->spkrID;
+        return session_->spkrID;
     }
 
     vector<string> Decoder::GetSpkrList() {
         return config_-> GetIDList();
     }
+
+    bool GetSearchResults(const DecoderModel &model, LatticeFasterOnlineDecoder *search,
+                          bool best_path_only, bool end_of_utterance, bool rescore,
+                          CompactLattice *clat, bool *lattice_ok,
+                          std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths,
+                          std::vector<float> *confs) {
+        const DecoderConfig &config = *model.config;
+        Lattice raw_lat;
+        bool ok;
+        if(best_path_only) {
+            ok = search->GetBestPath(&raw_lat, end_of_utterance);
+        } else {
+            ok = search->GetRawLattice(&raw_lat, end_of_utterance);
+        }
+
+        BaseFloat lat_beam = config.decoder_opts.lattice_beam;
+        DeterminizeLatticePhonePrunedWrapper(*model.trans_model, &raw_lat, lat_beam, clat,
+                                             config.decoder_opts.det_opts);
+        if(rescore && model.rescorer != NULL && !model.rescorer->Rescore(clat)) {
+            ok = false;
+        }
+        if(lattice_ok != NULL) {
+            *lattice_ok = ok;
+        }
+        if(words == NULL) {
+            return ok;
+        }
+
+        CompactLattice best_path;
+        CompactLattice aligned_best_path;
+        CompactLatticeShortestPath(*clat, &best_path);
+        if(config.word_boundary_rxfilename != "") {
+            ok = ok && WordAlignLattice(best_path, *model.trans_model, *model.word_boundary_info, 0,
+                                        &aligned_best_path);
+        } else {
+            aligned_best_path = best_path;
+        }
+        ok = ok && CompactLatticeToWordAlignment(aligned_best_path, words, times, lengths);
+        if(confs != NULL) {
+            MinimumBayesRisk mbr(*clat, *words, true);
+            *confs = mbr.GetOneBestConfidences();
+        }
+        // Frames dropped in the long-audio mode.
+        for(size_t i = 0; i < times->size(); i++) {
+            (*times)[i] += search->FrameOffset();
+        }
+
+        return ok;
+    }
 }
@@ -1,12 +1,22 @@
 #ifndef ALEX_ASR_DECODER_
 #define ALEX_ASR_DECODER_
+#include <map>
 #include <vector>
 #include <memory>
 #include "fst/fst-decl.h"
 #include "base/kaldi-types.h"
 
+#include "src/decodable_chunked.h"
+#include "src/decodable_offset.h"
 #include "src/decoder_config.h"
+#include "src/decoder_model.h"
+#include "src/decoder_listener.h"
+#include "src/decoding_graph.h"
 #include "src/feature_pipeline.h"
+#include "src/final_result.h"
+#include "src/lattice_faster_online_decoder.h"
+#include "src/lm_rescorer.h"
+#include "src/session_log.h"
 
 #include "feat/online-feature.h"
 #include "matrix/matrix-lib.h"
@@ -23,56 +33,163 @@
 using namespace kaldi;
 
 namespace alex_asr {
+    // Which limits of SessionBudgetOptions the current utterance hit.
+    struct SessionBudgetStatus {
+        bool beam_tightened;
+        bool best_path_only;
+        bool endpoint_forced;
+
+        SessionBudgetStatus() : beam_tightened(false), best_path_only(false), endpoint_forced(false) { }
+    };
+
     class Decoder {
     public:
         //Decoder(const string model_path);
         Decoder(const string model_path);
+        // Uses the current model of the manager and switches to a reloaded
+        // one at the next Reset(). The manager is not owned and must outlive
+        // the decoder.
+        Decoder(ModelManager *manager);
         ~Decoder();
 
         int32 Decode(int32 max_frames);
         void FrameIn(unsigned char *buffer, int32 buffer_length);
         void FrameIn(VectorBase<BaseFloat> *waveform_in);
-        bool GetBestPath(std::vector<int> *v_out, BaseFloat *prob);
-        bool GetLattice(fst::VectorFst<fst::LogArc> * out_fst, double *tot_lik, bool end_of_utt=true);
-        bool GetTimeAlignment(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths);
-        bool GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths, std::vector<float> *confs);
+        bool GetBestPath(std::vector<int> *v_out, BaseFloat *prob, int32 graph = 0);
+        bool GetLattice(fst::VectorFst<fst::LogArc> * out_fst, double *tot_lik, bool end_of_utt=true,
+                        int32 graph = 0);
+        bool GetLatticeBuffer(std::vector<char> *buffer, bool with_alignments, bool end_of_utt=true,
+                              int32 graph = 0);
+        bool GetTimeAlignment(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths,
+                              int32 graph = 0);
+        bool GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths, std::vector<float> *confs,
+                                                int32 graph = 0);
+        bool GetConfusionNetwork(std::vector<std::vector<int> > *words,
+                                 std::vector<std::vector<float> > *posteriors,
+                                 std::vector<float> *begin_times,
+                                 std::vector<float> *end_times,
+                                 int32 graph = 0);
         string GetWord(int word_id);
+        // Graph 0 is the main graph ("main"), followed by the --extra_graphs.
+        // The result getters take the index of the graph to read.
+        std::vector<string> GetGraphNames();
         void InputFinished();
         bool EndpointDetected();
         void FinalizeDecoding();
-        void Reset();
-        float FinalRelativeCost();
+        void Reset(bool keep_adaptation = false);
+        // FinalizeDecoding() followed by Reset(keep_adaptation), but the
+        // final results of the main graph are computed on a worker thread of
+        // this decoder while the next utterance is decoded. The caller must
+        // Unref() the returned result.
+        FinalResult *FinalizeDecodingAsync(bool keep_adaptation = false);
+        void GetAdaptationState(string *state_out);
+        void SetAdaptationState(const string &state_in);
+        void Checkpoint(string *checkpoint_out);
+        void Restore(const string &checkpoint_in);
+        float FinalRelativeCost(int32 graph = 0);
         int32 NumFramesDecoded();
+        // Whether only the keyword graph is searched, waiting for a keyword
+        // (with --keyword_graph).
+        bool KeywordGated();
         int32 TrailingSilenceLength();
+        void GetPoolStats(DecoderPoolStats *stats);
+        void GetBudgetStatus(SessionBudgetStatus *status);
+        // Calls the listener (not owned; NULL to stop) when the results
+        // change during Decode() and FinalizeDecoding().
+        void SetListener(DecoderListener *listener);
+        // Moves out the words committed in the long-audio mode and the words
+        // of the segments finalized with --auto_segment since the last call
+        // (only kept while no listener is set; the listener gets them through
+        // OnCommit() and OnSegment()). Times and lengths are in frames.
+        void GetCommittedResult(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths);
         void GetIvector(std::vector<float> *ivector);
         void SetBitsPerSample(int n_bits);
         int GetBitsPerSample();
+        void SetInputSamplingFrequency(int32 samp_freq);
+        int32 GetInputSamplingFrequency();
         float GetFrameShift();
+        void SetClassPhrases(const string &class_name, const std::vector<string> &phrases,
+                             const std::vector<float> &costs);
+        void ClearClasses();
         void SetSpkrID(string spkr_ID);
         string GetSpkrID();
         vector<string> GetSpkrList();
     private:
+        DecoderModel *model_;
+        ModelManager *manager_;
+        DecoderConfig *config_;  // Owned by model_.
+        SessionConfig *session_;
         FeaturePipeline *feature_pipeline_;
 
-        fst::StdFst *hclg_;
+        fst::StdFst *hclg_;  // Either model_->hclg or composed_hclg_.
+        fst::StdFst *composed_hclg_;
+        fst::StdFst *g_classes_;
+        std::map<int32, fst::StdVectorFst *> class_fsts_;
         LatticeFasterOnlineDecoder *decoder_;
-        TransitionModel *trans_model_;
-        nnet2::AmNnet *am_nnet2_;
-        nnet3::AmNnetSimple *am_nnet3_;
-        AmDiagGmm *am_gmm_;
-        fst::SymbolTable *words_;
-        DecoderConfig *config_;
+        std::vector<LatticeFasterOnlineDecoder *> extra_decoders_;  // One per model_->extra_hclgs.
+        LatticeFasterOnlineDecoder *keyword_decoder_;  // Searches model_->keyword_hclg; NULL without it.
         DecodableInterface *decodable_;
-        WordBoundaryInfo *word_boundary_info_;
+        DecodableChunked *chunked_decodable_;  // Inside decodable_ with --frames-per-chunk; not owned.
+        AdaptationState *adaptation_state_;
+        SessionLog *session_log_;
+        DecoderListener *listener_;
+        FinalizeWorker *finalize_worker_;  // Started by the first FinalizeDecodingAsync().
+        // What the listener has been told about the current utterance.
+        std::vector<int32> partial_words_;
+        int32 num_stable_words_;
+        bool endpoint_reported_;
+        SessionBudgetStatus budget_status_;
+        bool input_finished_;
+        int64 num_input_samples_;  // Input samples of the utterance, for --max_session_frames.
+        // Long-audio mode (--long_audio_commit_secs): feature_pipeline_ is
+        // restarted part way into the utterance; its first frame is search
+        // frame feature_start_frame_. The audio it got since then is kept,
+        // starting with input sample pipeline_audio_start_, to restart it.
+        int32 feature_start_frame_;
+        int64 pipeline_audio_start_;
+        std::vector<BaseFloat> pipeline_audio_;
+        std::vector<int32> committed_words_;
+        std::vector<int32> committed_times_;
+        std::vector<int32> committed_lengths_;
+        // Keyword-gated mode: while keyword_gated_, only keyword_decoder_ is
+        // advanced; the gate was closed at frame keyword_gate_frame_.
+        bool keyword_gated_;
+        int32 keyword_gate_frame_;
 
-        void InitTransformMatrices();
-        void LoadDecoder();
-        //void ParseConfig();
-        void ParseConfig();
-        void Deallocate();
-        bool FileExists(const std::string& name);
+        void Init();
+        void SwitchModel(DecoderModel *model);
+        void InitUtterance();
+        void CreateDecodable();
+        void CommitLongAudio();
+        void EndSegment();
+        void RestartFeaturePipeline(int32 first_frame);
+        void CloseKeywordGate(int32 frame);
+        int32 DecodeKeywords(int32 max_frames);
+        int32 FindKeyword(int32 *keyword);
+        void BuildGraph();
+        void NotifyListener(bool finalized = false);
+        int32 AdvanceSearches(int32 max_frames);
+        void CheckBudgets();
+        void ForceEndpoint(const string &reason);
+        void SetSearchOptions(const LatticeFasterDecoderConfig &decoder_opts);
+        LatticeFasterOnlineDecoder *Search(int32 graph);
+        bool GetDeterminizedLattice(CompactLattice *clat, bool end_of_utterance, int32 graph);
     };
 
+    // The lattice work behind the getters of Decoder and FinalResult.
+    // Determinizes the lattice of search (only its best path if
+    // best_path_only) into clat, rescored with the LM of model->rescorer if
+    // rescore is set. If words is not NULL, also aligns the best path of
+    // clat into words, their start frames in the utterance and lengths, and
+    // their MBR confidences if confs is not NULL. Returns false if the
+    // lattice or the requested alignment is incomplete; *lattice_ok (if not
+    // NULL) is false only for the former.
+    bool GetSearchResults(const DecoderModel &model, LatticeFasterOnlineDecoder *search,
+                          bool best_path_only, bool end_of_utterance, bool rescore,
+                          CompactLattice *clat, bool *lattice_ok,
+                          std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths,
+                          std::vector<float> *confs);
+
 /// @} end of "addtogroup online_latgen"
 
 } // namespace kaldi
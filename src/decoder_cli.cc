@@ -10,6 +10,33 @@
 using namespace kaldi;
 using namespace alex_asr;
 
+class PrintingListener : public DecoderListener {
+public:
+    PrintingListener(Decoder *decoder) : decoder_(decoder) { }
+
+    virtual void OnPartialResult(const std::vector<int32> &words) {
+        Print("hyp: ", words);
+    }
+
+    virtual void OnStablePrefix(const std::vector<int32> &words) {
+        Print("stable: ", words);
+    }
+
+    virtual void OnEndpoint() {
+        std::cout << "endpoint" << std::endl;
+    }
+private:
+    void Print(const char *what, const std::vector<int32> &words) {
+        std::cout << what;
+        for (size_t i = 0; i < words.size(); i++) {
+            std::cout << decoder_->GetWord(words[i]) << ' ';
+        }
+        std::cout << std::endl;
+    }
+
+    Decoder *decoder_;
+};
+
 int main(int argc, const char* const* argv) {
     Decoder * decoder = new Decoder(argv[2]);
 
@@ -44,37 +71,22 @@ int main(int argc, const char* const* argv) {
         decoder->FrameIn(&waveform);
         decoder->InputFinished();
 
-        vector<int> words;
-        float32 prob;
+        PrintingListener listener(decoder);
+        decoder->SetListener(&listener);
         do {
             decoded_frames += decoded_now;
             decoded_now = decoder->Decode(max_decoded);
 
-            decoder->GetBestPath(&words, &prob);
-
             //vector<float> ivector;
             //decoder->GetIvector(&ivector);
 
 //            std::cout << "trail_sil " << decoder->TrailingSilenceLength() << " ";
 //            std::cout << "fin_cost " << decoder->FinalRelativeCost() << " ";
 //            std::cout << "dec_frames " << decoder->NumFramesDecoded() << " ";
-
-            std::cout << decoded_now << " hyp: ";
-            for (int32 i = 0; i < words.size(); i++) {
-                std::string s = decoder->GetWord(words[i]);
-                std::cout << s << ' ';
-            }
-
-//            std::cout << " | Ivector: ";
-//            for(int32 i = 0; i < ivector.size(); i++) {
-//                std::cout << ivector[i] << " ";
-//            }
-            std::cout << std::endl;
-
-
         } while (decoded_now > 0);
 
         decoder->FinalizeDecoding();
+        decoder->SetListener(NULL);
     }
 
     std::cerr << "Done.";
@@ -1,4 +1,5 @@
 #include "src/decoder_config.h"
+#include "src/fast_feature.h"
 #include "libs/kaldi/src/base/kaldi-common.h"
 #include "libs/kaldi/src/util/common-utils.h"
 #include "libs/kaldi/src/matrix/kaldi-matrix.h"
@@ -7,15 +8,32 @@ using namespace kaldi;
 namespace alex_asr {
 
     DecoderConfig::DecoderConfig() :
+            nnet3_frames_per_chunk(0),
             lda_mat(NULL),
-            spkr_mat(NULL),
             cmvn_mat(NULL),
             ivector_extraction_info(NULL),
             bits_per_sample(16),
+            input_samp_freq(0.0),
+            resample_num_zeros(6),
+            compose_cache_mb(256),
+            rescore_lm_scale(1.0),
             use_lda(false),
             use_ivectors(false),
             use_cmvn(false),
             use_pitch(false),
+            use_fused_transform(false),
+            relayout_graph(false),
+            enable_checkpoint(false),
+            long_audio_commit_secs(0.0),
+            auto_segment(false),
+            keyword_preroll_secs(0.5),
+            keyword_window_secs(10.0),
+            async_pitch(false),
+            async_base_feature(false),
+            fast_base_feature(false),
+            async_queue_size(16),
+            offline_feature_threads(0),
+            fused_transform_block(16),
             cfg_decoder(""),
             cfg_decodable(""),
             cfg_mfcc(""),
@@ -29,6 +47,7 @@ namespace alex_asr {
             spkrID(""),
             transform_reader(NULL)
     {
+        pthread_mutex_init(&transform_mutex_, NULL);
         decodable_opts.acoustic_scale = 0.1;
         nnet3_decodable_opts.acoustic_scale = 0.1;
         splice_opts.left_context = 0;
@@ -38,14 +57,13 @@ namespace alex_asr {
     DecoderConfig::~DecoderConfig() {
         delete lda_mat;
         lda_mat = NULL;
-        delete spkr_mat;
-        spkr_mat = NULL;
         delete cmvn_mat;
         cmvn_mat = NULL;
         delete ivector_extraction_info;
         ivector_extraction_info = NULL;
         delete transform_reader;
         transform_reader = NULL;
+        pthread_mutex_destroy(&transform_mutex_);
     }
 
     void DecoderConfig::Register(ParseOptions *po) {
@@ -53,6 +71,33 @@ namespace alex_asr {
         po->Register("feature_type", &feature_type_str, "Type of features. MFCC/FBANK");
         po->Register("model", &model_rxfilename, "Accoustic model filename.");
         po->Register("hclg", &fst_rxfilename, "HCLG FST filename.");
+        po->Register("relayout_graph", &relayout_graph, "Re-layout --hclg in memory when loading it "
+                "(see relayout_graph; prefer running the tool once offline).");
+        po->Register("extra_graphs", &extra_graphs_str, "Comma-separated list of name=HCLG-filename pairs. "
+                "The graphs are searched along with the main one, sharing its features and acoustic scores; "
+                "they must be built from the same model and words.");
+        po->Register("keyword_graph", &keyword_graph_rxfilename, "HCLG FST filename of a small graph "
+                "with the --keywords and a filler; only it is searched until a keyword is found, then the "
+                "main search starts. Built from the same model and words.");
+        po->Register("keywords", &keywords_str, "Comma-separated words of --keyword_graph that start "
+                "the main search when found.");
+        po->Register("keyword_preroll_secs", &keyword_preroll_secs, "The main search starts this many "
+                "seconds before the keyword found.");
+        po->Register("keyword_window_secs", &keyword_window_secs, "While waiting for a keyword, the "
+                "keyword search and the features are restarted every this many seconds, so that memory "
+                "stays flat.");
+        po->Register("hcl", &hcl_rxfilename, "HCL FST filename; composed on the fly with --g instead "
+                "of using --hclg. Use the olabel_lookahead FST type for lookahead composition.");
+        po->Register("g", &g_rxfilename, "G FST filename for on-the-fly composition with --hcl.");
+        po->Register("g_relabel", &g_relabel_rxfilename, "Relabeling pairs applied to the input labels of "
+                "--g (saved by fstconvert --save_relabel_opairs when converting --hcl).");
+        po->Register("compose_cache_mb", &compose_cache_mb, "Size of the state cache of the on-the-fly "
+                "composition in megabytes.");
+        po->Register("rescore_lm", &rescore_lm_rxfilename, "Const-arpa LM (see arpa-to-const-arpa) used to "
+                "rescore the lattices in a second pass. Empty means no rescoring.");
+        po->Register("rescore_old_lm", &rescore_old_lm_rxfilename, "G.fst of the LM compiled into the "
+                "decoding graph; its scores are removed from the lattices before rescoring.");
+        po->Register("rescore_lm_scale", &rescore_lm_scale, "Scale of the second pass LM scores.");
         po->Register("words", &words_rxfilename, "Word to ID mapping filename.");
         po->Register("word_boundary", &word_boundary_rxfilename, "data/lang/phones/word_boundary.int");
         po->Register("mat_lda", &lda_mat_rspecifier, "LDA matrix filename.");
@@ -63,7 +108,50 @@ namespace alex_asr {
         po->Register("use_ivectors", &use_ivectors, "Are we using ivector features?");
         po->Register("use_cmvn", &use_cmvn, "Are we using cmvn transform?");
         po->Register("use_pitch", &use_pitch, "Are we using pitch feature?");
+        po->Register("use_fused_transform", &use_fused_transform, "Apply splicing, LDA and the speaker "
+                "transform as a single precomputed transform on blocks of frames?");
+        po->Register("fused_transform_block", &fused_transform_block, "Number of frames transformed at once "
+                "by the fused transform.");
+        po->Register("post_lattice_beam", &post_opts.beam, "Beam for pruning the word posterior lattice "
+                "before it is minimized (0 = no pruning).");
+        po->Register("post_lattice_max_arcs", &post_opts.max_arcs, "Maximum number of arcs of the word "
+                "posterior lattice; the pruning beam is tightened until it fits, down to the best path (0 = no limit).");
+        po->Register("decoder_pool_block", &pool_opts.block_size, "Number of search tokens (or lattice "
+                "links) the decoder allocates at once.");
+        po->Register("decoder_pool_max_mb", &pool_opts.max_mb, "Memory for search tokens and lattice links "
+                "kept by a decoder between utterances; a larger pool is returned to the system at Reset.");
+        po->Register("max_session_tokens", &budget_opts.max_tokens, "Search tokens one utterance may keep; "
+                "above it the beams are tightened, above twice as many an endpoint is forced (0 = no limit).");
+        po->Register("max_session_lattice_arcs", &budget_opts.max_lattice_arcs, "Lattice links one utterance "
+                "may keep; above it only the best path is kept (0 = no limit).");
+        po->Register("max_session_frames", &budget_opts.max_frames, "Feature frames of one utterance; above "
+                "it an endpoint is forced and further audio is ignored (0 = no limit).");
+        po->Register("budget_beam_factor", &budget_opts.beam_factor, "Factor applied to the beams when "
+                "--max_session_tokens is exceeded.");
+        po->Register("enable_checkpoint", &enable_checkpoint, "Record the input of each utterance so that "
+                "a running session can be checkpointed and restored in another process.");
+        po->Register("long_audio_commit_secs", &long_audio_commit_secs, "For streams decoded without "
+                "Reset() for a long time: every this many seconds the stable prefix of the hypothesis is "
+                "committed, and the search history and feature frames before it are freed (0 = disabled).");
+        po->Register("auto_segment", &auto_segment, "Finalize the hypothesis at each endpoint and start "
+                "the next segment of the stream right away, on the same features (needs silence phones "
+                "in --cfg_endpoint).");
+        po->Register("async_pitch", &async_pitch, "Compute the pitch feature on a worker thread?");
+        po->Register("async_base_feature", &async_base_feature, "Compute the MFCC/FBANK feature on a worker thread?");
+        po->Register("fast_base_feature", &fast_base_feature, "Compute the MFCC/FBANK feature for whole "
+                "audio blocks at once with a precomputed FFT and sparse mel weights? Kaldi's feature is "
+                "used for options this is not implemented for.");
+        po->Register("async_queue_size", &async_queue_size, "Maximum number of audio chunks queued for "
+                "a feature worker thread before accepting audio blocks.");
+        po->Register("offline_feature_threads", &offline_feature_threads, "For audio decoded as a whole: "
+                "compute the MFCC/FBANK feature at input_finished on this many threads. No frames are "
+                "decoded before input_finished. 0 computes the feature as the audio arrives.");
         po->Register("bits_per_sample", &bits_per_sample, "Bits per sample for input.");
+        po->Register("input_samp_freq", &input_samp_freq, "Sampling frequency of the input audio. "
+                "If it differs from the model's sampling frequency, the audio is resampled on the fly. "
+                "0 means the input comes at the model's sampling frequency.");
+        po->Register("resample_num_zeros", &resample_num_zeros, "Number of zeros of the resampling "
+                "filter on each side (trades resampling quality for latency).");
 
         po->Register("cfg_decoder", &cfg_decoder, "");
         po->Register("cfg_decodable", &cfg_decodable, "");
@@ -77,17 +165,47 @@ namespace alex_asr {
         po->Register("cfg_pitch", &cfg_pitch, "");
     }
 
-    void DecoderConfig::LoadConfigs(const string cfg_file) {
-        std::string model_path("");
+    namespace {
+        // The nnet3 options of cfg_decodable: Kaldi's own and the chunking.
+        struct Nnet3DecodableConfig {
+            nnet3::DecodableNnet3OnlineOptions *opts;
+            int32 *frames_per_chunk;
+
+            void Register(OptionsItf *po) {
+                opts->Register(po);
+                po->Register("frames-per-chunk", frames_per_chunk, "Evaluate the network for at "
+                        "least this many output frames at a time, so that its context is recomputed "
+                        "once per chunk; frames are decoded in whole chunks until the input is "
+                        "finished. 0 evaluates whatever frames are ready.");
+            }
+        };
+    }
+
+    void DecoderConfig::LoadConfigs(const string &model_path, const string &cfg_file) {
+        model_path_ = model_path;
 
         ParseOptions po("");
         Register(&po);
 
         KALDI_VLOG(2) << "Reading master config file: " << cfg_file;
-        po.ReadConfigFile(cfg_file);
+        po.ReadConfigFile(ModelFile(cfg_file));
+
+        // The model directory is not the working directory; other threads
+        // may be using the process while a model is reloaded.
+        string *model_files[] = {
+                &cfg_decoder, &cfg_decodable, &cfg_mfcc, &cfg_fbank, &cfg_cmvn, &cfg_splice, &cfg_delta,
+                &cfg_endpoint, &cfg_ivector, &cfg_pitch,
+                &model_rxfilename, &fst_rxfilename, &hcl_rxfilename, &g_rxfilename, &g_relabel_rxfilename,
+                &keyword_graph_rxfilename, &rescore_lm_rxfilename, &rescore_old_lm_rxfilename,
+                &words_rxfilename, &word_boundary_rxfilename, &lda_mat_rspecifier, &fcmvn_mat_rspecifier
+        };
+        for(size_t i = 0; i < sizeof(model_files) / sizeof(model_files[0]); i++) {
+            *model_files[i] = ModelFile(*model_files[i]);
+        }
 
         if(model_type_str == "nnet3") {
-            LoadConfig(cfg_decodable, &nnet3_decodable_opts);
+            Nnet3DecodableConfig nnet3_config = { &nnet3_decodable_opts, &nnet3_frames_per_chunk };
+            LoadConfig(cfg_decodable, &nnet3_config);
         } else {
             LoadConfig(cfg_decodable, &decodable_opts);
         }
@@ -100,6 +218,12 @@ namespace alex_asr {
         LoadConfig(cfg_delta, &delta_opts);
         LoadConfig(cfg_endpoint, &endpoint_config);
         LoadConfig(cfg_ivector, &ivector_config);
+        ivector_config.lda_mat_rxfilename = ModelFile(ivector_config.lda_mat_rxfilename);
+        ivector_config.global_cmvn_stats_rxfilename = ModelFile(ivector_config.global_cmvn_stats_rxfilename);
+        ivector_config.cmvn_config_rxfilename = ModelFile(ivector_config.cmvn_config_rxfilename);
+        ivector_config.splice_config_rxfilename = ModelFile(ivector_config.splice_config_rxfilename);
+        ivector_config.diag_ubm_rxfilename = ModelFile(ivector_config.diag_ubm_rxfilename);
+        ivector_config.ivector_extractor_rxfilename = ModelFile(ivector_config.ivector_extractor_rxfilename);
         LoadConfig(cfg_pitch, &pitch_opts);
         LoadConfig(cfg_pitch, &pitch_process_opts);
 
@@ -113,18 +237,17 @@ namespace alex_asr {
 
         if (transform_rspecifier != "") {
             if (transform_rspecifier.substr(0,4)!= "ark:"){
-                std::string fullpath = std::string(realpath(transform_rspecifier.c_str(), NULL));
-                transform_rspecifier = "ark:" + fullpath;
+                transform_rspecifier = "ark:" + ModelFile(transform_rspecifier);
+            } else {
+                transform_rspecifier = "ark:" + ModelFile(transform_rspecifier.substr(4));
             }
             KALDI_PARANOID_ASSERT(transform_reader == NULL);
             transform_reader = new RandomAccessBaseFloatMatrixReader(transform_rspecifier);
         }
 
         if (spkrID!="" && spkrID!="None" && spkrID!="NoSpkrID"){
-            bool res = true; 
-            res &= OptionCheck(transform_rspecifier == "",
-                           "You have to specify --trans_file when you specify --spkrID.");
-            LoadSpkrTransform();
+            OptionCheck(transform_rspecifier == "",
+                        "You have to specify --trans_file when you specify --spkrID.");
         }
 
         if (use_cmvn) {
@@ -146,14 +269,22 @@ namespace alex_asr {
         lda_mat->Read(ki.Stream(), binary_in);
     }
 
-    void DecoderConfig::LoadSpkrTransform(){
+    void DecoderConfig::ReadSpkrTransform(const string &spkr_id, Matrix<BaseFloat> *transform) {
         KALDI_VLOG(2) << "Loading transform file";
-        KALDI_VLOG(2) << "the Speaker ID is " << spkrID;
-        KALDI_PARANOID_ASSERT(transform_reader != NULL);
-        const Matrix<BaseFloat> &trans = transform_reader->Value(spkrID);
+        KALDI_VLOG(2) << "the Speaker ID is " << spkr_id;
+        if(transform_reader == NULL) {
+            KALDI_ERR << "You have to specify --trans_file when you specify --spkrID.";
+        }
 
-        KALDI_PARANOID_ASSERT(spkr_mat == NULL);
-        spkr_mat = new Matrix<BaseFloat>(trans);
+        // The reader is shared by all sessions using this configuration.
+        pthread_mutex_lock(&transform_mutex_);
+        try {
+            *transform = transform_reader->Value(spkr_id);
+        } catch(...) {
+            pthread_mutex_unlock(&transform_mutex_);
+            throw;
+        }
+        pthread_mutex_unlock(&transform_mutex_);
     }
 
     void DecoderConfig::LoadCMVN() {
@@ -171,6 +302,14 @@ namespace alex_asr {
         ivector_extraction_info = new OnlineIvectorExtractionInfo(ivector_config);
     }
 
+    string DecoderConfig::ModelFile(const string &filename) const {
+        if(model_path_ == "" || filename == "" || filename == "-" || filename[0] == '/' ||
+                filename[filename.size() - 1] == '|') {
+            return filename;
+        }
+        return model_path_ + "/" + filename;
+    }
+
     template<typename C>
     void DecoderConfig::LoadConfig(string file_name, C *opts) {
         if (FileExists(file_name)) {
@@ -230,6 +369,13 @@ namespace alex_asr {
             KALDI_ERR << "You have to specify a valid feature_type.";
         }
 
+        if(fast_base_feature && !(feature_type == FBANK ? OnlineFastFeature::Supports(fbank_opts)
+                                                        : OnlineFastFeature::Supports(mfcc_opts))) {
+            KALDI_WARN << "--fast_base_feature needs --snip-edges=true, --round-to-power-of-two=true and "
+                       << "--htk-compat=false in the feature config; using Kaldi's feature.";
+            fast_base_feature = false;
+        }
+
         res &= OptionCheck(use_ivectors && cfg_ivector == "",
                            "You have to specify --cfg_ivector if you want to use ivectors.");
         res &= OptionCheck(use_cmvn && fcmvn_mat_rspecifier == "",
@@ -237,11 +383,105 @@ namespace alex_asr {
         res &= OptionCheck(use_pitch && cfg_pitch == "",
                            "You have to specify --cfg_pitch if you want to use pitch.");
 
+        res &= OptionCheck(use_fused_transform && (!use_lda || cfg_delta != "" || model_type == NNET3),
+                           "--use_fused_transform requires --use_lda, no --cfg_delta and a GMM/NNET2 model.");
+
+        res &= OptionCheck(fused_transform_block <= 0,
+                           "--fused_transform_block must be positive.");
+
+        res &= OptionCheck(post_opts.beam < 0.0 || post_opts.max_arcs < 0,
+                           "--post_lattice_beam and --post_lattice_max_arcs must not be negative.");
+
+        res &= OptionCheck(pool_opts.block_size <= 0 || pool_opts.max_mb < 0,
+                           "--decoder_pool_block must be positive and --decoder_pool_max_mb must not be negative.");
+
+        res &= OptionCheck(budget_opts.max_tokens < 0 || budget_opts.max_lattice_arcs < 0 ||
+                           budget_opts.max_frames < 0,
+                           "--max_session_tokens, --max_session_lattice_arcs and --max_session_frames "
+                           "must not be negative.");
+
+        res &= OptionCheck(budget_opts.beam_factor <= 0.0 || budget_opts.beam_factor > 1.0,
+                           "--budget_beam_factor must be in (0, 1].");
+
+        res &= OptionCheck(long_audio_commit_secs < 0.0,
+                           "--long_audio_commit_secs must not be negative.");
+
+        // Kaldi draws the dithering noise from the process-wide Rand(), so a
+        // replay in another process would compute different features.
+        res &= OptionCheck(enable_checkpoint &&
+                           (feature_type == FBANK ? fbank_opts.frame_opts : mfcc_opts.frame_opts).dither != 0.0,
+                           "--enable_checkpoint needs --dither=0 in the feature config; dithering cannot be replayed.");
+
+        res &= OptionCheck(long_audio_commit_secs > 0.0 && (enable_checkpoint || extra_graphs_str != ""),
+                           "--long_audio_commit_secs cannot be used with --enable_checkpoint or --extra_graphs.");
+
+        res &= OptionCheck(auto_segment && endpoint_config.silence_phones == "",
+                           "--auto_segment needs the silence phones of the endpointing config (--cfg_endpoint).");
+
+        res &= OptionCheck(nnet3_frames_per_chunk < 0,
+                           "--frames-per-chunk of --cfg_decodable must not be negative.");
+
+        keywords.clear();
+        SplitStringToVector(keywords_str, ",", true, &keywords);
+        res &= OptionCheck(keyword_graph_rxfilename != "" && keywords.empty(),
+                           "You have to specify --keywords if you want to use --keyword_graph.");
+
+        res &= OptionCheck(keyword_preroll_secs < 0.0 || keyword_window_secs <= 0.0,
+                           "--keyword_preroll_secs must not be negative and --keyword_window_secs must be positive.");
+
+        res &= OptionCheck(keyword_graph_rxfilename != "" && (long_audio_commit_secs > 0.0 || enable_checkpoint),
+                           "--keyword_graph cannot be used with --long_audio_commit_secs or --enable_checkpoint.");
+
+        res &= OptionCheck(async_queue_size <= 0,
+                           "--async_queue_size must be positive.");
+
+        res &= OptionCheck(offline_feature_threads < 0,
+                           "--offline_feature_threads must not be negative.");
+
+        res &= OptionCheck(offline_feature_threads > 0 && async_base_feature,
+                           "--offline_feature_threads cannot be combined with --async_base_feature.");
+
+        res &= OptionCheck(offline_feature_threads > 0 &&
+                           !(feature_type == FBANK ? fbank_opts.frame_opts : mfcc_opts.frame_opts).snip_edges,
+                           "--offline_feature_threads requires --snip-edges=true in the feature config.");
+
+        res &= OptionCheck(input_samp_freq < 0.0,
+                           "--input_samp_freq must not be negative.");
+
+        res &= OptionCheck(resample_num_zeros <= 0,
+                           "--resample_num_zeros must be positive.");
+
+        res &= OptionCheck(rescore_lm_rxfilename != "" && rescore_old_lm_rxfilename == "",
+                           "You have to specify --rescore_old_lm if you want to use --rescore_lm.");
+
+        res &= OptionCheck(rescore_lm_scale <= 0.0,
+                           "--rescore_lm_scale must be positive.");
+
         res &= OptionCheck(model_rxfilename == "",
                            "You have to specify --model.");
 
-        res &= OptionCheck(fst_rxfilename == "",
-                           "You have to specify --hclg.");
+        res &= OptionCheck(fst_rxfilename == "" && (hcl_rxfilename == "" || g_rxfilename == ""),
+                           "You have to specify either --hclg or both --hcl and --g.");
+
+        res &= OptionCheck(fst_rxfilename != "" && (hcl_rxfilename != "" || g_rxfilename != ""),
+                           "--hclg cannot be combined with --hcl and --g.");
+
+        res &= OptionCheck(relayout_graph && fst_rxfilename == "",
+                           "--relayout_graph can only be used with --hclg.");
+
+        extra_graphs.clear();
+        std::vector<string> graph_specs;
+        SplitStringToVector(extra_graphs_str, ",", true, &graph_specs);
+        for(size_t i = 0; i < graph_specs.size(); i++) {
+            size_t pos = graph_specs[i].find('=');
+            res &= OptionCheck(pos == string::npos || pos == 0 || pos + 1 == graph_specs[i].size(),
+                               "--extra_graphs expects name=filename pairs, got: " + graph_specs[i]);
+            extra_graphs.push_back(std::make_pair(graph_specs[i].substr(0, pos),
+                                                  ModelFile(graph_specs[i].substr(pos + 1))));
+        }
+
+        res &= OptionCheck(compose_cache_mb <= 0,
+                           "--compose_cache_mb must be positive.");
 
         res &= OptionCheck(words_rxfilename == "",
                            "You have to specify --words.");
@@ -287,15 +527,11 @@ namespace alex_asr {
         }
     }
 
-    void DecoderConfig::ChangeSpkrID(string spkr_ID){
-        this->spkrID = spkr_ID;
-        if(spkr_ID!="" && spkr_ID!="None" && spkr_ID!="NoSpkrID"){
-            delete(spkr_mat);
-            spkr_mat = NULL;
-            bool res = true; 
-            res &= OptionCheck(transform_rspecifier == "",
-                           "You have to specify --trans_file when you specify --spkrID.");
-            LoadSpkrTransform();    
+    BaseFloat DecoderConfig::InputSamplingFrequency() const {
+        if(input_samp_freq > 0.0) {
+            return input_samp_freq;
+        } else {
+            return SamplingFrequency();
         }
     }
 
@@ -316,4 +552,64 @@ namespace alex_asr {
         
         return speakers;
     }
+
+    SessionConfig::SessionConfig(DecoderConfig *config) :
+            bits_per_sample(config->bits_per_sample),
+            input_samp_freq(config->input_samp_freq),
+            spkrID(""),
+            spkr_mat(NULL),
+            config_(config),
+            fused_mat_(NULL)
+    {
+        ChangeSpkrID(config->spkrID);
+    }
+
+    SessionConfig::~SessionConfig() {
+        delete spkr_mat;
+        spkr_mat = NULL;
+        delete fused_mat_;
+        fused_mat_ = NULL;
+    }
+
+    void SessionConfig::ChangeSpkrID(string spkr_ID){
+        this->spkrID = spkr_ID;
+        delete fused_mat_;
+        fused_mat_ = NULL;
+        delete spkr_mat;
+        spkr_mat = NULL;
+        if(HasSpkrTransform()){
+            spkr_mat = new Matrix<BaseFloat>();
+            config_->ReadSpkrTransform(spkr_ID, spkr_mat);
+        }
+    }
+
+    bool SessionConfig::HasSpkrTransform() const {
+        return spkrID != "" && spkrID != "None" && spkrID != "NoSpkrID";
+    }
+
+    BaseFloat SessionConfig::InputSamplingFrequency() const {
+        if(input_samp_freq > 0.0) {
+            return input_samp_freq;
+        } else {
+            return config_->SamplingFrequency();
+        }
+    }
+
+    const Matrix<BaseFloat> &SessionConfig::FusedTransform(int32 input_dim) {
+        // Computed once per speaker; ChangeSpkrID() invalidates it.
+        if(fused_mat_ == NULL || fused_mat_->NumCols() != input_dim + 1) {
+            delete fused_mat_;
+            fused_mat_ = new Matrix<BaseFloat>();
+
+            if(HasSpkrTransform()) {
+                ComposeAffineTransforms(*config_->lda_mat, *spkr_mat, input_dim, fused_mat_);
+            } else {
+                ToAffineTransform(*config_->lda_mat, input_dim, fused_mat_);
+            }
+            KALDI_VLOG(2) << "Fused transform for speaker '" << spkrID << "': "
+                          << fused_mat_->NumRows() << "x" << fused_mat_->NumCols();
+        }
+
+        return *fused_mat_;
+    }
 }
@@ -1,6 +1,7 @@
 #ifndef ALEX_ASR_DECODER_CONFIG_H_
 #define ALEX_ASR_DECODER_CONFIG_H_
 
+#include <pthread.h>
 #include <sys/stat.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -17,11 +18,31 @@
 #include "online2/online-ivector-feature.h"
 #include "util/stl-utils.h"
 #include "src/utils.h"
+#include "src/splice_transform.h"
+#include "src/lattice_faster_online_decoder.h"
 
 
 using namespace kaldi;
 
 namespace alex_asr {
+    // Limits on the resources one utterance may use; 0 means no limit.
+    struct SessionBudgetOptions {
+        // Search tokens kept by the decoder. Above the limit the beams are
+        // tightened by beam_factor; above twice the limit an endpoint is forced.
+        int32 max_tokens;
+        // Lattice links kept by the decoder. Above the limit only the best
+        // path is kept, and the lattices consist of the best path only.
+        int32 max_lattice_arcs;
+        // Feature frames of the utterance. Above the limit an endpoint is
+        // forced and further audio is ignored.
+        int32 max_frames;
+        BaseFloat beam_factor;
+
+        SessionBudgetOptions() : max_tokens(0), max_lattice_arcs(0), max_frames(0), beam_factor(0.5) { }
+
+        bool Enabled() const { return max_tokens > 0 || max_lattice_arcs > 0 || max_frames > 0; }
+    };
+
     class DecoderConfig {
     public:
         enum ModelType { NoneModelType, GMM, NNET2, NNET3 };
@@ -31,16 +52,25 @@ namespace alex_asr {
         DecoderConfig();
         ~DecoderConfig();
         void Register(ParseOptions *po);
-        void LoadConfigs(const string cfg_file);
-        void ChangeSpkrID(string spkr_ID);
+        // Reads cfg_file of the model directory model_path. The relative
+        // filenames of the configuration are resolved against model_path.
+        void LoadConfigs(const string &model_path, const string &cfg_file);
+        // filename relative to the model directory, unless it is absolute,
+        // empty, "-" or a pipe.
+        string ModelFile(const string &filename) const;
         bool InitAndCheck();
         BaseFloat FrameShiftInSeconds() const;
         BaseFloat SamplingFrequency() const;
+        BaseFloat InputSamplingFrequency() const;
         vector<string> GetIDList();
+        void ReadSpkrTransform(const string &spkr_id, Matrix<BaseFloat> *transform);
 
         LatticeFasterDecoderConfig decoder_opts;
         nnet2::DecodableNnet2OnlineOptions decodable_opts;
         nnet3::DecodableNnet3OnlineOptions nnet3_decodable_opts;
+        // Output frames per nnet3 evaluation (--frames-per-chunk of
+        // cfg_decodable); 0 evaluates whatever frames are ready.
+        int32 nnet3_frames_per_chunk;
         MfccOptions mfcc_opts;
         FbankOptions fbank_opts;
         OnlineCmvnOptions cmvn_opts;
@@ -49,22 +79,47 @@ namespace alex_asr {
         OnlineEndpointConfig endpoint_config;
         OnlineIvectorExtractionConfig ivector_config;
         PitchExtractionOptions pitch_opts;
+        WordsPostOptions post_opts;
+        DecoderPoolOptions pool_opts;
+        SessionBudgetOptions budget_opts;
         ProcessPitchOptions pitch_process_opts;
 
         Matrix<BaseFloat> *lda_mat;
-        Matrix<BaseFloat> *spkr_mat;
         Matrix<double> *cmvn_mat;
         OnlineIvectorExtractionInfo *ivector_extraction_info;
 
         ModelType model_type;
         FeatureType feature_type;
         int32 bits_per_sample;
+        BaseFloat input_samp_freq;
+        int32 resample_num_zeros;
+        int32 compose_cache_mb;
+        BaseFloat rescore_lm_scale;
 
         bool use_lda;
         bool use_delta;
         bool use_ivectors;
         bool use_cmvn;
         bool use_pitch;
+        bool use_fused_transform;
+        bool relayout_graph;
+        bool enable_checkpoint;
+        // Interval of the commits of the long-audio mode; 0 disables it.
+        BaseFloat long_audio_commit_secs;
+        // Finalize a segment at each endpoint and go on with the next one.
+        bool auto_segment;
+        // Keyword-gated mode (--keyword_graph): only the keyword graph is
+        // searched until one of the keywords is found.
+        BaseFloat keyword_preroll_secs;
+        BaseFloat keyword_window_secs;
+        bool async_pitch;
+        bool async_base_feature;
+        bool fast_base_feature;
+        int32 async_queue_size;
+        // Threads computing the MFCC/FBANK feature of the whole audio at
+        // InputFinished; 0 computes it as the audio arrives.
+        int32 offline_feature_threads;
+        int32 fused_transform_block;
 
         std::string cfg_decoder;
         std::string cfg_decodable;
@@ -79,6 +134,17 @@ namespace alex_asr {
 
         std::string model_rxfilename;
         std::string fst_rxfilename;
+        std::string hcl_rxfilename;
+        std::string g_rxfilename;
+        std::string g_relabel_rxfilename;
+        std::string extra_graphs_str;
+        std::string keyword_graph_rxfilename;
+        std::string keywords_str;
+        std::vector<std::string> keywords;
+        // (name, rxfilename) of the graphs searched along with the main one.
+        std::vector<std::pair<std::string, std::string> > extra_graphs;
+        std::string rescore_lm_rxfilename;
+        std::string rescore_old_lm_rxfilename;
         std::string words_rxfilename;
         std::string word_boundary_rxfilename;
         std::string lda_mat_rspecifier;
@@ -87,7 +153,6 @@ namespace alex_asr {
         std::string spkrID;
     private:
         void InitAux();
-        void LoadSpkrTransform();
         void LoadLDA();
         void LoadCMVN();
         void LoadIvector();
@@ -95,11 +160,33 @@ namespace alex_asr {
         bool FileExists(string strFilename);
         bool OptionCheck(bool cond, std::string fail_text);
         RandomAccessBaseFloatMatrixReader *transform_reader;
+        pthread_mutex_t transform_mutex_;
+        string model_path_;
         // SequentialBaseFloatMatrixReader *speaker_reader;
 
         string model_type_str;
         string feature_type_str;
     };
+
+    // The settings one decoding session can change on top of a DecoderConfig
+    // shared with other sessions: the input format and the speaker transform.
+    class SessionConfig {
+    public:
+        SessionConfig(DecoderConfig *config);
+        ~SessionConfig();
+        void ChangeSpkrID(string spkr_ID);
+        bool HasSpkrTransform() const;
+        BaseFloat InputSamplingFrequency() const;
+        const Matrix<BaseFloat> &FusedTransform(int32 input_dim);
+
+        int32 bits_per_sample;
+        BaseFloat input_samp_freq;
+        std::string spkrID;
+        Matrix<BaseFloat> *spkr_mat;
+    private:
+        DecoderConfig *config_;
+        Matrix<BaseFloat> *fused_mat_;
+    };
 }
 
 #endif //PYKALDI_PYKALDI2_DECODER_CONFIG_H
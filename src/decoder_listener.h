@@ -0,0 +1,99 @@
+#ifndef ALEX_ASR_DECODER_LISTENER_H_
+#define ALEX_ASR_DECODER_LISTENER_H_
+
+#include <vector>
+
+#include "base/kaldi-types.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Receives the results of a Decoder as they change; see
+    // Decoder::SetListener(). The callbacks are made from Decode() and
+    // FinalizeDecoding() only when there is something new.
+    class DecoderListener {
+    public:
+        virtual ~DecoderListener() { }
+
+        // The best hypothesis of the main graph changed.
+        virtual void OnPartialResult(const std::vector<int32> &words) { }
+        // The stable prefix of the hypothesis grew: these words will not
+        // change any more in this utterance. After FinalizeDecoding() the
+        // whole hypothesis is stable.
+        virtual void OnStablePrefix(const std::vector<int32> &words) { }
+        // An endpoint was detected; reported once per utterance.
+        virtual void OnEndpoint() { }
+        // In the long-audio mode (--long_audio_commit_secs), the stable prefix
+        // was committed: these words, with their start frames and lengths in
+        // frames of the whole utterance, are dropped from the decoder, and
+        // the later results start after them.
+        virtual void OnCommit(const std::vector<int32> &words, const std::vector<int32> &times,
+                              const std::vector<int32> &lengths) { }
+        // With --auto_segment, the decoder finalized a segment at an endpoint
+        // (after the OnEndpoint() and the final OnStablePrefix() of the
+        // segment); these are its words, aligned as by GetTimeAlignment().
+        // The next results belong to the next segment.
+        virtual void OnSegment(const std::vector<int32> &words, const std::vector<int32> &times,
+                               const std::vector<int32> &lengths) { }
+        // In the keyword-gated mode (--keyword_graph), this keyword was found
+        // and the main search started; its results follow.
+        virtual void OnKeyword(int32 word) { }
+    };
+
+    struct DecoderEvent {
+        enum EventType { kPartialResult = 0, kStablePrefix = 1, kEndpoint = 2, kCommit = 3, kSegment = 4,
+                         kKeyword = 5 };
+
+        int32 type;
+        std::vector<int32> words;
+        std::vector<int32> times;  // kCommit and kSegment only, as are lengths.
+        std::vector<int32> lengths;
+    };
+
+    // Listener which stores the events so that they can be handled later,
+    // e.g. by the Python wrapper after Decode() returns.
+    class DecoderEventQueue : public DecoderListener {
+    public:
+        virtual void OnPartialResult(const std::vector<int32> &words) {
+            Push(DecoderEvent::kPartialResult, words);
+        }
+        virtual void OnStablePrefix(const std::vector<int32> &words) {
+            Push(DecoderEvent::kStablePrefix, words);
+        }
+        virtual void OnEndpoint() {
+            Push(DecoderEvent::kEndpoint, std::vector<int32>());
+        }
+        virtual void OnCommit(const std::vector<int32> &words, const std::vector<int32> &times,
+                              const std::vector<int32> &lengths) {
+            Push(DecoderEvent::kCommit, words);
+            events_.back().times = times;
+            events_.back().lengths = lengths;
+        }
+        virtual void OnSegment(const std::vector<int32> &words, const std::vector<int32> &times,
+                               const std::vector<int32> &lengths) {
+            Push(DecoderEvent::kSegment, words);
+            events_.back().times = times;
+            events_.back().lengths = lengths;
+        }
+
+        virtual void OnKeyword(int32 word) {
+            Push(DecoderEvent::kKeyword, std::vector<int32>(1, word));
+        }
+
+        // Moves the stored events to events_out, oldest first.
+        void PopAll(std::vector<DecoderEvent> *events_out) {
+            events_out->clear();
+            events_out->swap(events_);
+        }
+    private:
+        void Push(int32 type, const std::vector<int32> &words) {
+            events_.push_back(DecoderEvent());
+            events_.back().type = type;
+            events_.back().words = words;
+        }
+
+        std::vector<DecoderEvent> events_;
+    };
+}
+
+#endif  // ALEX_ASR_DECODER_LISTENER_H_
@@ -0,0 +1,305 @@
+#include "src/decoder_model.h"
+#include "src/decoding_graph.h"
+#include "src/utils.h"
+
+#include "online2/onlinebin-util.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    DecoderModel::DecoderModel(const string &model_path) :
+            config(NULL),
+            trans_model(NULL),
+            am_nnet2(NULL),
+            am_nnet3(NULL),
+            am_gmm(NULL),
+            hclg(NULL),
+            hcl(NULL),
+            g(NULL),
+            keyword_hclg(NULL),
+            words(NULL),
+            word_boundary_info(NULL),
+            rescorer(NULL),
+            path_(model_path),
+            ref_count_(1)
+    {
+        pthread_mutex_init(&ref_mutex_, NULL);
+    }
+
+    DecoderModel::~DecoderModel() {
+        delete config;
+        config = NULL;
+        delete trans_model;
+        trans_model = NULL;
+        delete am_nnet2;
+        am_nnet2 = NULL;
+        delete am_nnet3;
+        am_nnet3 = NULL;
+        delete am_gmm;
+        am_gmm = NULL;
+        delete hclg;
+        hclg = NULL;
+        delete hcl;
+        hcl = NULL;
+        delete g;
+        g = NULL;
+        for(size_t i = 0; i < extra_hclgs.size(); i++) {
+            delete extra_hclgs[i];
+        }
+        extra_hclgs.clear();
+        delete keyword_hclg;
+        keyword_hclg = NULL;
+        delete words;
+        words = NULL;
+        delete word_boundary_info;
+        word_boundary_info = NULL;
+        delete rescorer;
+        rescorer = NULL;
+        pthread_mutex_destroy(&ref_mutex_);
+    }
+
+    DecoderModel *DecoderModel::Load(const string &model_path) {
+        DecoderModel *model = new DecoderModel(model_path);
+
+        try {
+            KALDI_VLOG(2) << "Loading models: " << model_path;
+
+            model->ParseConfig();
+            model->LoadModels();
+        } catch(...) {
+            delete model;
+            throw;
+        }
+
+        KALDI_VLOG(2) << "Models are successfully loaded.";
+        return model;
+    }
+
+    void DecoderModel::Ref() {
+        pthread_mutex_lock(&ref_mutex_);
+        ref_count_++;
+        pthread_mutex_unlock(&ref_mutex_);
+    }
+
+    void DecoderModel::Unref() {
+        pthread_mutex_lock(&ref_mutex_);
+        bool last = (--ref_count_ == 0);
+        pthread_mutex_unlock(&ref_mutex_);
+
+        if(last) {
+            KALDI_VLOG(2) << "Freeing models: " << path_;
+            delete this;
+        }
+    }
+
+    void DecoderModel::ParseConfig() {
+        KALDI_PARANOID_ASSERT(config == NULL);
+
+        config = new DecoderConfig();
+
+        // The configuration resolves its filenames against path_; the working
+        // directory is left alone.
+        string dir = path_ == "" ? "" : path_ + "/";
+        string cfg_name;
+        if(FileExists(dir + "pykaldi.cfg")) {
+            cfg_name = "pykaldi.cfg";
+            KALDI_WARN << "Using deprecated configuration file. Please move pykaldi.cfg to alex_asr.conf.";
+        } else if(FileExists(dir + "alex_asr.conf")) {
+            cfg_name = "alex_asr.conf";
+        } else {
+            KALDI_ERR << "AlexASR Decoder configuration (alex_asr.conf) not found in model directory."
+                    "Please check your configuration.";
+        }
+
+        config->LoadConfigs(path_, cfg_name);
+
+        if(!config->InitAndCheck()) {
+            KALDI_ERR << "Error when checking if the configuration is valid. "
+                    "Please check your configuration.";
+        }
+    }
+
+    bool DecoderModel::FileExists(const std::string& name) {
+        struct stat buffer;
+        return (stat (name.c_str(), &buffer) == 0);
+    }
+
+    void DecoderModel::LoadModels() {
+        bool binary;
+        Input ki(config->model_rxfilename, &binary);
+
+        KALDI_PARANOID_ASSERT(trans_model == NULL);
+        trans_model = new TransitionModel();
+        trans_model->Read(ki.Stream(), binary);
+
+        if(config->model_type == DecoderConfig::GMM) {
+            KALDI_PARANOID_ASSERT(am_gmm == NULL);
+            am_gmm = new AmDiagGmm();
+            am_gmm->Read(ki.Stream(), binary);
+        } else if(config->model_type == DecoderConfig::NNET2) {
+            KALDI_PARANOID_ASSERT(am_nnet2 == NULL);
+            am_nnet2 = new nnet2::AmNnet();
+            am_nnet2->Read(ki.Stream(), binary);
+        } else if(config->model_type == DecoderConfig::NNET3) {
+            KALDI_PARANOID_ASSERT(am_nnet3 == NULL);
+            am_nnet3 = new nnet3::AmNnetSimple();
+            am_nnet3->Read(ki.Stream(), binary);
+        }
+
+        KALDI_PARANOID_ASSERT(hclg == NULL);
+        if(config->fst_rxfilename != "") {
+            hclg = ReadDecodeGraph(config->fst_rxfilename);
+            if(config->relayout_graph) {
+                fst::StdFst *graph = hclg;
+                hclg = RelayoutGraph(*graph);
+                delete graph;
+            }
+        } else {
+            hcl = ReadGraph(config->hcl_rxfilename);
+            if(config->g_relabel_rxfilename != "") {
+                ReadRelabelPairs(config->g_relabel_rxfilename, &g_relabel_pairs);
+            }
+            g = ReadGrammar(config->g_rxfilename, g_relabel_pairs);
+        }
+
+        KALDI_PARANOID_ASSERT(extra_hclgs.empty());
+        for(size_t i = 0; i < config->extra_graphs.size(); i++) {
+            fst::StdFst *graph = ReadDecodeGraph(config->extra_graphs[i].second);
+            if(config->relayout_graph) {
+                fst::StdFst *relayout = RelayoutGraph(*graph);
+                delete graph;
+                graph = relayout;
+            }
+            extra_hclgs.push_back(graph);
+        }
+
+        KALDI_PARANOID_ASSERT(words == NULL);
+        words = fst::SymbolTable::ReadText(config->words_rxfilename);
+
+        KALDI_PARANOID_ASSERT(keyword_hclg == NULL);
+        if(config->keyword_graph_rxfilename != "") {
+            keyword_hclg = ReadDecodeGraph(config->keyword_graph_rxfilename);
+            for(size_t i = 0; i < config->keywords.size(); i++) {
+                int64 id = words->Find(config->keywords[i]);
+                if(id == fst::SymbolTable::kNoSymbol) {
+                    KALDI_ERR << "Keyword " << config->keywords[i] << " is not in " << config->words_rxfilename;
+                }
+                keyword_ids.push_back(static_cast<int32>(id));
+            }
+        }
+
+        KALDI_PARANOID_ASSERT(word_boundary_info == NULL);
+        if(config->word_boundary_rxfilename != "") {
+            WordBoundaryInfoNewOpts word_boundary_info_opts;
+            word_boundary_info = new WordBoundaryInfo(word_boundary_info_opts, config->word_boundary_rxfilename);
+        }
+
+        KALDI_PARANOID_ASSERT(rescorer == NULL);
+        if(config->rescore_lm_rxfilename != "") {
+            rescorer = new LatticeRescorer(config->rescore_old_lm_rxfilename,
+                                           config->rescore_lm_rxfilename,
+                                           config->rescore_lm_scale);
+        }
+    }
+
+    ModelManager::ModelManager(const string &model_path) :
+            model_(NULL),
+            reload_thread_joinable_(false),
+            reloading_(false)
+    {
+        model_ = DecoderModel::Load(model_path);
+        pthread_mutex_init(&mutex_, NULL);
+    }
+
+    ModelManager::~ModelManager() {
+        JoinReloadThread();
+        model_->Unref();
+        model_ = NULL;
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    bool ModelManager::Reload(const string &model_path) {
+        pthread_mutex_lock(&mutex_);
+        if(reloading_) {
+            pthread_mutex_unlock(&mutex_);
+            return false;
+        }
+        reloading_ = true;
+        reload_path_ = model_path;
+        reload_error_ = "";
+        pthread_mutex_unlock(&mutex_);
+
+        // The previous reload has finished; collect its thread.
+        JoinReloadThread();
+        if(pthread_create(&reload_thread_, NULL, &ModelManager::ReloadThread, this) != 0) {
+            pthread_mutex_lock(&mutex_);
+            reloading_ = false;
+            pthread_mutex_unlock(&mutex_);
+            KALDI_ERR << "Could not start model reload thread.";
+        }
+        reload_thread_joinable_ = true;
+        return true;
+    }
+
+    bool ModelManager::Reloading() {
+        pthread_mutex_lock(&mutex_);
+        bool reloading = reloading_;
+        pthread_mutex_unlock(&mutex_);
+        return reloading;
+    }
+
+    bool ModelManager::WaitForReload(string *error) {
+        JoinReloadThread();
+
+        pthread_mutex_lock(&mutex_);
+        *error = reload_error_;
+        pthread_mutex_unlock(&mutex_);
+        return error->empty();
+    }
+
+    DecoderModel *ModelManager::AcquireModel() {
+        pthread_mutex_lock(&mutex_);
+        DecoderModel *model = model_;
+        model->Ref();
+        pthread_mutex_unlock(&mutex_);
+        return model;
+    }
+
+    void ModelManager::JoinReloadThread() {
+        if(reload_thread_joinable_) {
+            pthread_join(reload_thread_, NULL);
+            reload_thread_joinable_ = false;
+        }
+    }
+
+    void *ModelManager::ReloadThread(void *arg) {
+        ModelManager *manager = static_cast<ModelManager *>(arg);
+
+        DecoderModel *model = NULL;
+        string error;
+        try {
+            model = DecoderModel::Load(manager->reload_path_);
+        } catch(const std::exception &e) {
+            error = e.what();
+        }
+
+        DecoderModel *old_model = NULL;
+        pthread_mutex_lock(&manager->mutex_);
+        if(model != NULL) {
+            KALDI_LOG << "Switched to the models in " << model->Path();
+            old_model = manager->model_;
+            manager->model_ = model;
+        } else {
+            manager->reload_error_ = error.empty() ? "Unknown error." : error;
+            KALDI_WARN << "Reloading the models from " << manager->reload_path_
+                       << " failed; keeping " << manager->model_->Path() << ": " << error;
+        }
+        manager->reloading_ = false;
+        pthread_mutex_unlock(&manager->mutex_);
+
+        if(old_model != NULL) {
+            old_model->Unref();
+        }
+        return NULL;
+    }
+}
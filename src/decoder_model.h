@@ -0,0 +1,109 @@
+#ifndef ALEX_ASR_DECODER_MODEL_H_
+#define ALEX_ASR_DECODER_MODEL_H_
+
+#include <pthread.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fst/fst-decl.h"
+#include "base/kaldi-types.h"
+#include "gmm/am-diag-gmm.h"
+#include "hmm/transition-model.h"
+#include "lat/word-align-lattice.h"
+#include "nnet2/am-nnet.h"
+#include "nnet3/am-nnet-simple.h"
+
+#include "src/decoder_config.h"
+#include "src/lm_rescorer.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Everything loaded from a model directory: the configuration, the
+    // acoustic model, the decoding graph and the word list. It is not modified
+    // after loading, so one instance is shared by all the decoders using it.
+    // The instance is reference counted and deleted by the last Unref().
+    class DecoderModel {
+    public:
+        // Loads the model directory with a reference count of one.
+        static DecoderModel *Load(const string &model_path);
+
+        void Ref();
+        void Unref();
+
+        const string &Path() const { return path_; }
+
+        DecoderConfig *config;
+        TransitionModel *trans_model;
+        nnet2::AmNnet *am_nnet2;
+        nnet3::AmNnetSimple *am_nnet3;
+        AmDiagGmm *am_gmm;
+        // The decoding graph: either hclg, or hcl and g composed on the fly.
+        fst::StdFst *hclg;
+        fst::StdFst *hcl;
+        fst::StdFst *g;
+        std::vector<std::pair<int32, int32> > g_relabel_pairs;
+        // Graphs of --extra_graphs, in the order of the configuration.
+        std::vector<fst::StdFst *> extra_hclgs;
+        // Graph of --keyword_graph (NULL without it) and the IDs of --keywords.
+        fst::StdFst *keyword_hclg;
+        std::vector<int32> keyword_ids;
+        fst::SymbolTable *words;
+        WordBoundaryInfo *word_boundary_info;
+        LatticeRescorer *rescorer;
+    private:
+        DecoderModel(const string &model_path);
+        ~DecoderModel();
+
+        void ParseConfig();
+        void LoadModels();
+        bool FileExists(const std::string& name);
+
+        string path_;
+        int32 ref_count_;
+        pthread_mutex_t ref_mutex_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(DecoderModel);
+    };
+
+    // Hands out the current model to the decoders and replaces it by a new one
+    // loaded on a background thread. Decoders pick up the new model when they
+    // are reset; the old one is freed when the last decoder using it lets go.
+    // AcquireModel() may be called from any thread, Reload() and
+    // WaitForReload() from one controlling thread only. The manager must
+    // outlive every Decoder created from it; they acquire models from it
+    // at each Reset().
+    class ModelManager {
+    public:
+        // Loads the initial model synchronously.
+        ModelManager(const string &model_path);
+        ~ModelManager();
+
+        // Starts loading a model directory in the background. Returns false if
+        // another reload is still running.
+        bool Reload(const string &model_path);
+        bool Reloading();
+        // Waits for the last reload. Returns false and fills error if it failed;
+        // the previous model stays in use then.
+        bool WaitForReload(string *error);
+
+        // The current model with a reference added; the caller must Unref() it.
+        DecoderModel *AcquireModel();
+    private:
+        static void *ReloadThread(void *arg);
+        void JoinReloadThread();
+
+        DecoderModel *model_;
+        pthread_mutex_t mutex_;
+        pthread_t reload_thread_;
+        bool reload_thread_joinable_;
+        bool reloading_;
+        string reload_path_;
+        string reload_error_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(ModelManager);
+    };
+}
+
+#endif  // ALEX_ASR_DECODER_MODEL_H_
@@ -0,0 +1,171 @@
+#include "src/decoding_graph.h"
+
+#include <deque>
+#include <limits>
+
+#include "fst/matcher-fst.h"
+#include "fstext/kaldi-fst-io.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+
+namespace fst {
+    // The lookahead FST type lives in an OpenFst extension which is not
+    // registered by default.
+    static FstRegisterer<StdOLabelLookAheadFst> OLabelLookAheadFst_StdArc_registerer;
+}
+
+namespace alex_asr {
+    fst::StdFst *ReadGraph(const std::string &rxfilename) {
+        Input ki(rxfilename);
+        if(!ki.Stream().good()) {
+            KALDI_ERR << "Could not open FST " << rxfilename;
+        }
+
+        fst::FstReadOptions ropts(rxfilename);
+        fst::StdFst *graph = fst::StdFst::Read(ki.Stream(), ropts);
+        if(graph == NULL) {
+            KALDI_ERR << "Could not read FST " << rxfilename
+                      << " (unknown FST type or arc type other than standard?)";
+        }
+
+        return graph;
+    }
+
+    void ReadRelabelPairs(const std::string &rxfilename,
+                          std::vector<std::pair<int32, int32> > *pairs) {
+        pairs->clear();
+        if(!fst::ReadLabelPairs(rxfilename, pairs, false)) {
+            KALDI_ERR << "Could not read relabeling pairs from " << rxfilename;
+        }
+    }
+
+    fst::StdVectorFst *ReadGrammar(const std::string &rxfilename,
+                                   const std::vector<std::pair<int32, int32> > &relabel_pairs) {
+        fst::StdVectorFst *g = fst::ReadFstKaldi(rxfilename);
+
+        if(!relabel_pairs.empty()) {
+            std::vector<std::pair<int32, int32> > no_pairs;
+            fst::Relabel(g, relabel_pairs, no_pairs);
+        }
+
+        if(g->Properties(fst::kILabelSorted, true) == 0) {
+            fst::ILabelCompare<fst::StdArc> ilabel_comp;
+            fst::ArcSort(g, ilabel_comp);
+        }
+
+        return g;
+    }
+
+    fst::StdVectorFst *PhrasesToFst(const std::vector<std::vector<int32> > &phrases,
+                                    const std::vector<BaseFloat> &costs,
+                                    const std::vector<std::pair<int32, int32> > &relabel_pairs) {
+        KALDI_ASSERT(phrases.size() == costs.size());
+
+        fst::StdVectorFst *phrases_fst = new fst::StdVectorFst();
+        fst::StdArc::StateId start = phrases_fst->AddState();
+        fst::StdArc::StateId final = phrases_fst->AddState();
+        phrases_fst->SetStart(start);
+        phrases_fst->SetFinal(final, fst::TropicalWeight::One());
+
+        for(size_t i = 0; i < phrases.size(); i++) {
+            const std::vector<int32> &phrase = phrases[i];
+            if(phrase.empty()) {
+                KALDI_WARN << "Skipping an empty phrase.";
+                continue;
+            }
+
+            // The cost of the phrase goes on its first arc.
+            fst::StdArc::StateId state = start;
+            for(size_t j = 0; j < phrase.size(); j++) {
+                fst::StdArc::StateId next = (j + 1 == phrase.size()) ? final : phrases_fst->AddState();
+                fst::TropicalWeight weight = (j == 0) ? fst::TropicalWeight(costs[i]) : fst::TropicalWeight::One();
+                phrases_fst->AddArc(state, fst::StdArc(phrase[j], phrase[j], weight, next));
+                state = next;
+            }
+        }
+
+        if(!relabel_pairs.empty()) {
+            std::vector<std::pair<int32, int32> > no_pairs;
+            fst::Relabel(phrases_fst, relabel_pairs, no_pairs);
+        }
+
+        return phrases_fst;
+    }
+
+    fst::StdFst *ReplaceClasses(const fst::StdFst &g,
+                                const std::vector<std::pair<int32, const fst::StdFst *> > &classes,
+                                size_t cache_size) {
+        // Any label unused by the grammar can identify the root FST.
+        const int32 root_label = std::numeric_limits<int32>::max();
+
+        std::vector<std::pair<int32, const fst::StdFst *> > fsts(classes);
+        fsts.push_back(std::make_pair(root_label, &g));
+
+        // Calls and returns become epsilon arcs, so the HCL never sees the
+        // nonterminals.
+        fst::ReplaceFstOptions<fst::StdArc> replace_opts(root_label, true);
+        replace_opts.gc = true;
+        replace_opts.gc_limit = cache_size;
+        fst::ReplaceFst<fst::StdArc> replaced(fsts, replace_opts);
+
+        fst::ILabelCompare<fst::StdArc> ilabel_comp;
+        fst::CacheOptions cache_opts(true, cache_size);
+        return new fst::ArcSortFst<fst::StdArc, fst::ILabelCompare<fst::StdArc> >(replaced, ilabel_comp,
+                                                                                  cache_opts);
+    }
+
+    fst::StdConstFst *RelayoutGraph(const fst::StdFst &graph) {
+        typedef fst::StdArc::StateId StateId;
+
+        fst::StdVectorFst vector_graph(graph);
+        StateId num_states = vector_graph.NumStates();
+        if(vector_graph.Start() == fst::kNoStateId) {
+            return new fst::StdConstFst(vector_graph);
+        }
+
+        std::vector<StateId> order(num_states, fst::kNoStateId);
+        std::deque<StateId> queue;
+        StateId next_id = 0;
+
+        order[vector_graph.Start()] = next_id++;
+        queue.push_back(vector_graph.Start());
+        while(!queue.empty()) {
+            StateId s = queue.front();
+            queue.pop_front();
+            for(fst::ArcIterator<fst::StdVectorFst> aiter(vector_graph, s); !aiter.Done(); aiter.Next()) {
+                StateId next = aiter.Value().nextstate;
+                if(order[next] == fst::kNoStateId) {
+                    order[next] = next_id++;
+                    queue.push_back(next);
+                }
+            }
+        }
+
+        // States unreachable from the start go last.
+        for(StateId s = 0; s < num_states; s++) {
+            if(order[s] == fst::kNoStateId) {
+                order[s] = next_id++;
+            }
+        }
+
+        fst::StateSort(&vector_graph, order);
+        return new fst::StdConstFst(vector_graph);
+    }
+
+    void WriteGraph(const fst::StdFst &graph, const std::string &wxfilename) {
+        Output ko(wxfilename, true);
+        if(!graph.Write(ko.Stream(), fst::FstWriteOptions(wxfilename))) {
+            KALDI_ERR << "Could not write FST to " << wxfilename;
+        }
+        ko.Close();
+    }
+
+    fst::StdFst *ComposeGraph(const fst::StdFst &hcl, const fst::StdFst &g,
+                              size_t cache_size) {
+        // ComposeFst picks the lookahead matcher and filter by itself when
+        // hcl supports it.
+        fst::CacheOptions cache_opts(true, cache_size);
+        return new fst::ComposeFst<fst::StdArc>(hcl, g, cache_opts);
+    }
+}
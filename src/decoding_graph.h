@@ -0,0 +1,57 @@
+#ifndef ALEX_ASR_DECODING_GRAPH_H_
+#define ALEX_ASR_DECODING_GRAPH_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Reads an FST of any type known to OpenFst (vector, const, and the
+    // olabel_lookahead type produced by fstconvert --fst_type=olabel_lookahead).
+    fst::StdFst *ReadGraph(const std::string &rxfilename);
+
+    // Reads the relabeling pairs saved by fstconvert --save_relabel_opairs
+    // when the HCL was converted to the olabel_lookahead type.
+    void ReadRelabelPairs(const std::string &rxfilename,
+                          std::vector<std::pair<int32, int32> > *pairs);
+
+    // Reads the grammar G.fst for on-the-fly composition, with the input labels
+    // relabeled by relabel_pairs (may be empty).
+    fst::StdVectorFst *ReadGrammar(const std::string &rxfilename,
+                                   const std::vector<std::pair<int32, int32> > &relabel_pairs);
+
+    // Builds an FST accepting the given phrases (sequences of word ids), each
+    // with its own cost; a negative cost boosts the phrase. Input labels are
+    // relabeled like those of the grammar.
+    fst::StdVectorFst *PhrasesToFst(const std::vector<std::vector<int32> > &phrases,
+                                    const std::vector<BaseFloat> &costs,
+                                    const std::vector<std::pair<int32, int32> > &relabel_pairs);
+
+    // Lazily replaces the arcs of g whose output label is a class nonterminal
+    // by the FST of the class. The result is sorted on input labels so that it
+    // can be composed with the HCL.
+    fst::StdFst *ReplaceClasses(const fst::StdFst &g,
+                                const std::vector<std::pair<int32, const fst::StdFst *> > &classes,
+                                size_t cache_size);
+
+    // Copies the graph into a ConstFst, with the states renumbered in the
+    // breadth-first order from the start state. The arcs of all states are then
+    // stored in one contiguous array, and states expanded close to each other
+    // during the search lie close to each other in memory.
+    fst::StdConstFst *RelayoutGraph(const fst::StdFst &graph);
+
+    void WriteGraph(const fst::StdFst &graph, const std::string &wxfilename);
+
+    // Lazy composition HCL o G. If hcl is an olabel_lookahead FST, the
+    // composition uses label and weight lookahead. The cache of expanded
+    // states is garbage collected once it exceeds cache_size bytes.
+    fst::StdFst *ComposeGraph(const fst::StdFst &hcl, const fst::StdFst &g,
+                              size_t cache_size);
+}
+
+#endif  // ALEX_ASR_DECODING_GRAPH_H_
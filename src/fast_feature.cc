@@ -0,0 +1,238 @@
+#include "src/fast_feature.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "feat/mel-computations.h"
+#include "matrix/matrix-functions.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    OnlineFastFeature::OnlineFastFeature(const MfccOptions &opts) :
+            is_mfcc_(true),
+            mfcc_opts_(opts),
+            frame_opts_(opts.frame_opts),
+            use_energy_(opts.use_energy),
+            raw_energy_(opts.raw_energy),
+            energy_floor_(opts.energy_floor),
+            num_bins_(opts.mel_opts.num_bins),
+            dim_(opts.num_ceps),
+            window_function_(opts.frame_opts),
+            srfft_(NULL),
+            waveform_offset_(0),
+            num_frames_(0),
+            input_finished_(false)
+    {
+        KALDI_ASSERT(Supports(opts));
+        Init(opts.mel_opts);
+
+        Matrix<BaseFloat> dct_matrix(num_bins_, num_bins_);
+        ComputeDctMatrix(&dct_matrix);
+        dct_matrix_.Resize(opts.num_ceps, num_bins_);
+        dct_matrix_.CopyFromMat(SubMatrix<BaseFloat>(dct_matrix, 0, opts.num_ceps, 0, num_bins_));
+        if(opts.cepstral_lifter != 0.0) {
+            lifter_coeffs_.Resize(opts.num_ceps);
+            ComputeLifterCoeffs(opts.cepstral_lifter, &lifter_coeffs_);
+        }
+    }
+
+    OnlineFastFeature::OnlineFastFeature(const FbankOptions &opts) :
+            is_mfcc_(false),
+            fbank_opts_(opts),
+            frame_opts_(opts.frame_opts),
+            use_energy_(opts.use_energy),
+            raw_energy_(opts.raw_energy),
+            energy_floor_(opts.energy_floor),
+            num_bins_(opts.mel_opts.num_bins),
+            dim_(opts.mel_opts.num_bins + (opts.use_energy ? 1 : 0)),
+            window_function_(opts.frame_opts),
+            srfft_(NULL),
+            waveform_offset_(0),
+            num_frames_(0),
+            input_finished_(false)
+    {
+        KALDI_ASSERT(Supports(opts));
+        Init(opts.mel_opts);
+    }
+
+    OnlineFastFeature::~OnlineFastFeature() {
+        delete srfft_;
+        srfft_ = NULL;
+    }
+
+    bool OnlineFastFeature::Supports(const MfccOptions &opts) {
+        return opts.frame_opts.snip_edges && opts.frame_opts.round_to_power_of_two && !opts.htk_compat;
+    }
+
+    bool OnlineFastFeature::Supports(const FbankOptions &opts) {
+        return opts.frame_opts.snip_edges && opts.frame_opts.round_to_power_of_two && !opts.htk_compat;
+    }
+
+    void OnlineFastFeature::Init(const MelBanksOptions &mel_opts) {
+        srfft_ = new SplitRadixRealFft<BaseFloat>(frame_opts_.PaddedWindowSize());
+        MelBanks mel_banks(mel_opts, frame_opts_, 1.0);
+        mel_bins_ = mel_banks.GetBins();
+    }
+
+    int32 OnlineFastFeature::Dim() const {
+        return dim_;
+    }
+
+    BaseFloat OnlineFastFeature::FrameShiftInSeconds() const {
+        return frame_opts_.frame_shift_ms * 1.0e-03;
+    }
+
+    int32 OnlineFastFeature::NumFramesReady() const {
+        return num_frames_;
+    }
+
+    bool OnlineFastFeature::IsLastFrame(int32 frame) const {
+        return input_finished_ && frame == num_frames_ - 1;
+    }
+
+    void OnlineFastFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+        KALDI_ASSERT(frame >= 0 && frame < num_frames_);
+        feat->CopyFromVec(frames_.Row(frame));
+    }
+
+    void OnlineFastFeature::AcceptWaveform(BaseFloat sampling_rate,
+                                           const VectorBase<BaseFloat> &waveform) {
+        KALDI_ASSERT(!input_finished_);
+        if(sampling_rate != frame_opts_.samp_freq) {
+            KALDI_ERR << "Sampling frequency mismatch, expected " << frame_opts_.samp_freq
+                      << ", got " << sampling_rate;
+        }
+        if(waveform.Dim() == 0) {
+            return;
+        }
+
+        Vector<BaseFloat> appended(waveform_.Dim() + waveform.Dim(), kUndefined);
+        appended.Range(0, waveform_.Dim()).CopyFromVec(waveform_);
+        appended.Range(waveform_.Dim(), waveform.Dim()).CopyFromVec(waveform);
+        waveform_.Swap(&appended);
+        ComputeFrames();
+    }
+
+    void OnlineFastFeature::InputFinished() {
+        // With --snip-edges=true the end of the input completes no frame.
+        input_finished_ = true;
+    }
+
+    void OnlineFastFeature::ComputeFrames() {
+        int32 window_size = frame_opts_.WindowSize(),
+              window_shift = frame_opts_.WindowShift();
+        int64 num_samples = waveform_offset_ + waveform_.Dim();
+        int32 num_frames = 0;
+        if(num_samples >= window_size) {
+            num_frames = 1 + static_cast<int32>((num_samples - window_size) / window_shift);
+        }
+        int32 first_frame = num_frames_,
+              num_new = num_frames - first_frame;
+        if(num_new <= 0) {
+            return;
+        }
+        if(num_frames > frames_.NumRows()) {
+            frames_.Resize(std::max(num_frames, 2 * frames_.NumRows()), dim_, kCopyData);
+        }
+
+        Vector<BaseFloat> log_energy;
+        ComputeSpectra(static_cast<int64>(first_frame) * window_shift - waveform_offset_, num_new, &log_energy);
+
+        // Mel binning: one product of a band of the spectra of all frames
+        // with the weights of each bin.
+        const BaseFloat epsilon = std::numeric_limits<BaseFloat>::epsilon();
+        mel_energies_.Resize(num_new, num_bins_, kUndefined);
+        Vector<BaseFloat> bin_energies(num_new, kUndefined);
+        for(int32 bin = 0; bin < num_bins_; bin++) {
+            int32 offset = mel_bins_[bin].first;
+            const Vector<BaseFloat> &weights = mel_bins_[bin].second;
+            SubMatrix<BaseFloat> band(windows_, 0, num_new, offset, weights.Dim());
+            bin_energies.AddMatVec(1.0, band, kNoTrans, weights, 0.0);
+            mel_energies_.CopyColFromVec(bin_energies, bin);
+        }
+
+        SubMatrix<BaseFloat> features(frames_, first_frame, num_new, 0, dim_);
+        if(is_mfcc_) {
+            mel_energies_.ApplyFloor(epsilon);
+            mel_energies_.ApplyLog();
+            features.AddMatMat(1.0, mel_energies_, kNoTrans, dct_matrix_, kTrans, 0.0);
+            if(lifter_coeffs_.Dim() > 0) {
+                features.MulColsVec(lifter_coeffs_);
+            }
+            if(use_energy_) {
+                features.CopyColFromVec(log_energy, 0);
+            }
+        } else {
+            if(fbank_opts_.use_log_fbank) {
+                mel_energies_.ApplyFloor(epsilon);
+                mel_energies_.ApplyLog();
+            }
+            int32 mel_offset = use_energy_ ? 1 : 0;
+            features.ColRange(mel_offset, num_bins_).CopyFromMat(mel_energies_);
+            if(use_energy_) {
+                features.CopyColFromVec(log_energy, 0);
+            }
+        }
+        num_frames_ = num_frames;
+
+        // Keep the samples from the start of the next frame on.
+        int64 next_sample = static_cast<int64>(num_frames) * window_shift - waveform_offset_;
+        int32 num_consumed = static_cast<int32>(std::min<int64>(next_sample, waveform_.Dim()));
+        if(num_consumed > 0) {
+            Vector<BaseFloat> remainder(waveform_.Range(num_consumed, waveform_.Dim() - num_consumed));
+            waveform_.Swap(&remainder);
+            waveform_offset_ += num_consumed;
+        }
+    }
+
+    void OnlineFastFeature::ComputeSpectra(int32 first_sample, int32 num_frames, Vector<BaseFloat> *log_energy) {
+        int32 window_size = frame_opts_.WindowSize(),
+              window_shift = frame_opts_.WindowShift(),
+              padded_size = frame_opts_.PaddedWindowSize();
+        const BaseFloat epsilon = std::numeric_limits<BaseFloat>::epsilon();
+
+        // The padding past window_size stays zero.
+        windows_.Resize(num_frames, padded_size);
+        if(use_energy_) {
+            log_energy->Resize(num_frames);
+        }
+
+        SubMatrix<BaseFloat> windows(windows_, 0, num_frames, 0, window_size);
+        for(int32 frame = 0; frame < num_frames; frame++) {
+            SubVector<BaseFloat> window(windows, frame);
+            window.CopyFromVec(waveform_.Range(first_sample + frame * window_shift, window_size));
+            if(frame_opts_.dither != 0.0) {
+                Dither(&window, frame_opts_.dither);
+            }
+            if(frame_opts_.remove_dc_offset) {
+                window.Add(-window.Sum() / window_size);
+            }
+            if(use_energy_ && raw_energy_) {
+                (*log_energy)(frame) = Log(std::max(VecVec(window, window), epsilon));
+            }
+            if(frame_opts_.preemph_coeff != 0.0) {
+                Preemphasize(&window, frame_opts_.preemph_coeff);
+            }
+        }
+        windows.MulColsVec(window_function_.window);
+
+        for(int32 frame = 0; frame < num_frames; frame++) {
+            SubVector<BaseFloat> row(windows_, frame);
+            if(use_energy_ && !raw_energy_) {
+                SubVector<BaseFloat> window(row, 0, window_size);
+                (*log_energy)(frame) = Log(std::max(VecVec(window, window), epsilon));
+            }
+            srfft_->Compute(row.Data(), true);
+            // The power spectrum takes the first padded_size / 2 + 1 columns.
+            ComputePowerSpectrum(&row);
+        }
+        if(!is_mfcc_ && !fbank_opts_.use_power) {
+            SubMatrix<BaseFloat>(windows_, 0, num_frames, 0, padded_size / 2 + 1).ApplyPow(0.5);
+        }
+
+        if(use_energy_ && energy_floor_ > 0.0) {
+            log_energy->ApplyFloor(Log(energy_floor_));
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef ALEX_ASR_FAST_FEATURE_H_
+#define ALEX_ASR_FAST_FEATURE_H_
+
+#include <vector>
+
+#include "feat/feature-fbank.h"
+#include "feat/feature-mfcc.h"
+#include "feat/online-feature.h"
+#include "matrix/srfft.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // MFCC or FBANK feature computed like Kaldi's OnlineMfcc/OnlineFbank,
+    // but for all the frames of an audio block at once: the windows are cut
+    // into one matrix, transformed by a split-radix FFT planned once, binned
+    // with the sparse mel weights and, for MFCC, multiplied by the DCT matrix
+    // in one matrix product. The frames equal those of Kaldi's feature up to
+    // rounding (and the dithering noise). Only the options of Supports are
+    // handled; Kaldi's feature has to be used for the others.
+    class OnlineFastFeature : public OnlineBaseFeature {
+    public:
+        explicit OnlineFastFeature(const MfccOptions &opts);
+        explicit OnlineFastFeature(const FbankOptions &opts);
+        virtual ~OnlineFastFeature();
+
+        // Whether the options can be computed by this class: --snip-edges and
+        // --round-to-power-of-two must be true and --htk-compat false.
+        static bool Supports(const MfccOptions &opts);
+        static bool Supports(const FbankOptions &opts);
+
+        virtual int32 Dim() const;
+        virtual int32 NumFramesReady() const;
+        virtual bool IsLastFrame(int32 frame) const;
+        virtual BaseFloat FrameShiftInSeconds() const;
+        virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+        virtual void AcceptWaveform(BaseFloat sampling_rate,
+                                    const VectorBase<BaseFloat> &waveform);
+        virtual void InputFinished();
+    private:
+        void Init(const MelBanksOptions &mel_opts);
+        void ComputeFrames();
+        // Cuts, weights and transforms the windows of num_frames frames,
+        // the first starting at sample first_sample of waveform_; returns the
+        // log energies of the frames if energy is used.
+        void ComputeSpectra(int32 first_sample, int32 num_frames, Vector<BaseFloat> *log_energy);
+
+        bool is_mfcc_;
+        MfccOptions mfcc_opts_;
+        FbankOptions fbank_opts_;
+        FrameExtractionOptions frame_opts_;
+        bool use_energy_;
+        bool raw_energy_;
+        BaseFloat energy_floor_;
+        int32 num_bins_;
+        int32 dim_;
+
+        FeatureWindowFunction window_function_;
+        SplitRadixRealFft<BaseFloat> *srfft_;
+        // Sparse mel weights: (first FFT bin, weights) for each mel bin.
+        std::vector<std::pair<int32, Vector<BaseFloat> > > mel_bins_;
+        Matrix<BaseFloat> dct_matrix_;  // MFCC only.
+        Vector<BaseFloat> lifter_coeffs_;  // MFCC only; empty without liftering.
+
+        // Samples not consumed yet; the first one is input sample waveform_offset_.
+        Vector<BaseFloat> waveform_;
+        int64 waveform_offset_;
+        // Work space of ComputeFrames; one row per frame of the current block.
+        Matrix<BaseFloat> windows_;
+        Matrix<BaseFloat> mel_energies_;
+
+        // The first num_frames_ rows are the frames computed so far; the
+        // capacity is doubled when it runs out.
+        Matrix<BaseFloat> frames_;
+        int32 num_frames_;
+        bool input_finished_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineFastFeature);
+    };
+}
+
+#endif  // ALEX_ASR_FAST_FEATURE_H_
@@ -0,0 +1,100 @@
+#include "src/fast_feature.h"
+
+#include "feat/wave-reader.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+using namespace alex_asr;
+
+namespace {
+    // Feeds the waveform to both features in blocks of block_size samples
+    // and checks that they give the same frames up to rounding.
+    void CompareFeatures(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, int32 block_size,
+                         OnlineBaseFeature *expected, OnlineBaseFeature *actual) {
+        for(int32 offset = 0; offset < waveform.Dim(); offset += block_size) {
+            SubVector<BaseFloat> block(waveform, offset, std::min(block_size, waveform.Dim() - offset));
+            expected->AcceptWaveform(samp_freq, block);
+            actual->AcceptWaveform(samp_freq, block);
+            KALDI_ASSERT(actual->NumFramesReady() == expected->NumFramesReady());
+        }
+        expected->InputFinished();
+        actual->InputFinished();
+
+        int32 num_frames = expected->NumFramesReady();
+        KALDI_ASSERT(num_frames > 0 && actual->NumFramesReady() == num_frames);
+        KALDI_ASSERT(actual->Dim() == expected->Dim());
+        KALDI_ASSERT(actual->IsLastFrame(num_frames - 1) && !actual->IsLastFrame(num_frames - 2));
+
+        Vector<BaseFloat> expected_frame(expected->Dim()), actual_frame(actual->Dim());
+        for(int32 frame = 0; frame < num_frames; frame++) {
+            expected->GetFrame(frame, &expected_frame);
+            actual->GetFrame(frame, &actual_frame);
+            if(!actual_frame.ApproxEqual(expected_frame, 1.0e-03)) {
+                KALDI_ERR << "Frame " << frame << " differs: expected " << expected_frame
+                          << "got " << actual_frame;
+            }
+        }
+    }
+
+    void TestMfcc(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, bool use_energy) {
+        MfccOptions opts;
+        opts.frame_opts.dither = 0.0;
+        opts.frame_opts.samp_freq = samp_freq;
+        opts.use_energy = use_energy;
+        KALDI_ASSERT(OnlineFastFeature::Supports(opts));
+
+        OnlineMfcc expected(opts);
+        OnlineFastFeature actual(opts);
+        CompareFeatures(waveform, samp_freq, 1000, &expected, &actual);
+        KALDI_LOG << "MFCC with use_energy=" << use_energy << " matches.";
+    }
+
+    void TestFbank(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, bool use_energy) {
+        FbankOptions opts;
+        opts.frame_opts.dither = 0.0;
+        opts.frame_opts.samp_freq = samp_freq;
+        opts.use_energy = use_energy;
+        KALDI_ASSERT(OnlineFastFeature::Supports(opts));
+
+        OnlineFbank expected(opts);
+        OnlineFastFeature actual(opts);
+        CompareFeatures(waveform, samp_freq, 1000, &expected, &actual);
+        KALDI_LOG << "FBANK with use_energy=" << use_energy << " matches.";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Checks that OnlineFastFeature computes the frames of OnlineMfcc and OnlineFbank.\n"
+                "\n"
+                "Usage:  fast_feature_test [<wav-file>]\n";
+
+        ParseOptions po(usage);
+        po.Read(argc, argv);
+        if(po.NumArgs() > 1) {
+            po.PrintUsage();
+            exit(1);
+        }
+        std::string wav_rxfilename = po.NumArgs() == 1 ? po.GetArg(1) : "test/eleven.wav";
+
+        WaveData wave_data;
+        {
+            bool binary;
+            Input ki(wav_rxfilename, &binary);
+            wave_data.Read(ki.Stream());
+        }
+        SubVector<BaseFloat> waveform(wave_data.Data(), 0);
+
+        TestMfcc(waveform, wave_data.SampFreq(), true);
+        TestMfcc(waveform, wave_data.SampFreq(), false);
+        TestFbank(waveform, wave_data.SampFreq(), true);
+        TestFbank(waveform, wave_data.SampFreq(), false);
+
+        KALDI_LOG << "Test OK.";
+        return 0;
+    } catch(const std::exception &e) {
+        std::cerr << e.what();
+        return -1;
+    }
+}
@@ -5,7 +5,64 @@
 using namespace kaldi;
 
 namespace alex_asr {
-    FeaturePipeline::FeaturePipeline(DecoderConfig &config) :
+    AdaptationState::AdaptationState() :
+            ivector_state(NULL),
+            cmvn_state(NULL) { }
+
+    AdaptationState::~AdaptationState() {
+        delete ivector_state;
+        ivector_state = NULL;
+        delete cmvn_state;
+        cmvn_state = NULL;
+    }
+
+    void AdaptationState::Write(std::ostream &os, bool binary) const {
+        WriteToken(os, binary, "<AdaptationState>");
+        WriteToken(os, binary, "<Ivector>");
+        WriteBasicType(os, binary, ivector_state != NULL);
+        if(ivector_state) {
+            ivector_state->Write(os, binary);
+        }
+        WriteToken(os, binary, "<Cmvn>");
+        WriteBasicType(os, binary, cmvn_state != NULL);
+        if(cmvn_state) {
+            cmvn_state->Write(os, binary);
+        }
+        WriteToken(os, binary, "</AdaptationState>");
+    }
+
+    void AdaptationState::Read(std::istream &is, bool binary,
+                               const OnlineIvectorExtractionInfo *ivector_info) {
+        delete ivector_state;
+        ivector_state = NULL;
+        delete cmvn_state;
+        cmvn_state = NULL;
+
+        bool has_state;
+        ExpectToken(is, binary, "<AdaptationState>");
+        ExpectToken(is, binary, "<Ivector>");
+        ReadBasicType(is, binary, &has_state);
+        if(has_state) {
+            if(ivector_info == NULL) {
+                KALDI_ERR << "Adaptation state contains an ivector state but the model does not use ivectors.";
+            }
+            ivector_state = new OnlineIvectorExtractorAdaptationState(*ivector_info);
+            ivector_state->Read(is, binary);
+        }
+        ExpectToken(is, binary, "<Cmvn>");
+        ReadBasicType(is, binary, &has_state);
+        if(has_state) {
+            cmvn_state = new OnlineCmvnState();
+            cmvn_state->Read(is, binary);
+        }
+        ExpectToken(is, binary, "</AdaptationState>");
+    }
+
+    FeaturePipeline::FeaturePipeline(DecoderConfig &config, SessionConfig &session,
+                                     const AdaptationState *adaptation_state) :
+        samp_freq_(config.SamplingFrequency()),
+        input_samp_freq_(session.InputSamplingFrequency()),
+        resampler_(NULL),
         base_feature_(NULL),
         cmvn_(NULL),
         cmvn_state_(NULL),
@@ -13,73 +70,128 @@ namespace alex_asr {
         delta_(NULL),
         transform_lda_(NULL),
         transform_spkr_(NULL),
+        splice_transform_(NULL),
         ivector_(NULL),
         ivector_append_(NULL),
         pitch_(NULL),
         pitch_feature_(NULL),
         pitch_append_(NULL),
-        final_feature_(NULL)
+        final_feature_(NULL),
+        ivector_info_(config.ivector_extraction_info)
 
     {
         OnlineFeatureInterface *prev_feature;
-        
-        if(config.feature_type == DecoderConfig::MFCC) {
+
+        if(input_samp_freq_ != samp_freq_) {
+            // Streaming windowed-sinc resampler; its latency is bounded by
+            // resample_num_zeros / cutoff seconds of audio.
+            BaseFloat cutoff = 0.99 * 0.5 * std::min(input_samp_freq_, samp_freq_);
+            KALDI_VLOG(3) << "Resampling input " << input_samp_freq_ << " -> " << samp_freq_;
+            resampler_ = new LinearResample(static_cast<int32>(input_samp_freq_),
+                                            static_cast<int32>(samp_freq_),
+                                            cutoff,
+                                            config.resample_num_zeros);
+        }
+
+        if(config.offline_feature_threads > 0) {
+            KALDI_VLOG(3) << "Feature " << (config.feature_type == DecoderConfig::FBANK ? "FBANK" : "MFCC")
+                          << " of the whole audio on " << config.offline_feature_threads << " threads";
+            base_feature_ = new OnlineParallelFeature(config, config.offline_feature_threads);
+            KALDI_VLOG(3) << "    -> dims: " << base_feature_->Dim();
+        } else if(config.feature_type == DecoderConfig::MFCC) {
             KALDI_VLOG(3) << "Feature MFCC "
                           << config.mfcc_opts.mel_opts.low_freq
                           << " " << config.mfcc_opts.mel_opts.high_freq;
-            prev_feature = base_feature_ = new OnlineMfcc(config.mfcc_opts);
+            if(config.fast_base_feature) {
+                base_feature_ = new OnlineFastFeature(config.mfcc_opts);
+            } else {
+                base_feature_ = new OnlineMfcc(config.mfcc_opts);
+            }
             KALDI_VLOG(3) << "    -> dims: " << base_feature_->Dim();
         } else if(config.feature_type == DecoderConfig::FBANK) {
             KALDI_VLOG(3) << "Feature FBANK "
                           << config.fbank_opts.mel_opts.low_freq
                           << " " << config.fbank_opts.mel_opts.high_freq;
-            prev_feature = base_feature_ = new OnlineFbank(config.fbank_opts);
+            if(config.fast_base_feature) {
+                base_feature_ = new OnlineFastFeature(config.fbank_opts);
+            } else {
+                base_feature_ = new OnlineFbank(config.fbank_opts);
+            }
             KALDI_VLOG(3) << "    -> dims: " << base_feature_->Dim();
         } else {
             KALDI_ERR << "You have to specify a valid feature_type.";
         }
 
+        if(config.async_base_feature) {
+            KALDI_VLOG(3) << "    -> computed on a worker thread";
+            base_feature_ = new OnlineAsyncFeature(base_feature_, config.async_queue_size);
+        }
+        prev_feature = base_feature_;
+
         if(config.use_cmvn) {
             KALDI_VLOG(3) << "Feature CMVN";
-            cmvn_state_ = new OnlineCmvnState(*config.cmvn_mat);
+            if(adaptation_state != NULL && adaptation_state->cmvn_state != NULL) {
+                cmvn_state_ = new OnlineCmvnState(*adaptation_state->cmvn_state);
+            } else {
+                cmvn_state_ = new OnlineCmvnState(*config.cmvn_mat);
+            }
             prev_feature = cmvn_ = new OnlineCmvn(config.cmvn_opts, *cmvn_state_, prev_feature);
         }
 
         if(config.use_pitch) {
             pitch_ = new OnlinePitchFeature(config.pitch_opts);
+            if(config.async_pitch) {
+                KALDI_VLOG(3) << "Feature PITCH computed on a worker thread";
+                pitch_ = new OnlineAsyncFeature(pitch_, config.async_queue_size);
+            }
             pitch_feature_ = new OnlineProcessPitch(config.pitch_process_opts, pitch_);
             prev_feature = pitch_append_ = new OnlineAppendFeature(prev_feature, pitch_feature_);
         }
 
-        if(config.cfg_splice != "" && config.model_type != DecoderConfig::NNET3) {
-            // TODO
-            KALDI_VLOG(3) << "Feature SPLICE " << config.splice_opts.left_context << " " <<
+        if(config.use_fused_transform) {
+            int32 spliced_dim = prev_feature->Dim() *
+                    (config.splice_opts.left_context + config.splice_opts.right_context + 1);
+            KALDI_VLOG(3) << "Feature SPLICE+TRANSFORM " << config.splice_opts.left_context << " " <<
                           config.splice_opts.right_context;
-            prev_feature = splice_ = new OnlineSpliceFrames(config.splice_opts, prev_feature);
-            KALDI_VLOG(3) << "    -> dims: " << splice_->Dim();
-        }
+            prev_feature = splice_transform_ = new OnlineSpliceTransform(config.splice_opts,
+                                                                         session.FusedTransform(spliced_dim),
+                                                                         prev_feature,
+                                                                         config.fused_transform_block);
+            KALDI_VLOG(3) << "    -> dims: " << splice_transform_->Dim();
+        } else {
+            if(config.cfg_splice != "" && config.model_type != DecoderConfig::NNET3) {
+                // TODO
+                KALDI_VLOG(3) << "Feature SPLICE " << config.splice_opts.left_context << " " <<
+                              config.splice_opts.right_context;
+                prev_feature = splice_ = new OnlineSpliceFrames(config.splice_opts, prev_feature);
+                KALDI_VLOG(3) << "    -> dims: " << splice_->Dim();
+            }
 
-        if(config.cfg_delta != "") {
-            KALDI_VLOG(3) << "Feature DELTA";
-            prev_feature = delta_ = new OnlineDeltaFeature(config.delta_opts, prev_feature);
-            KALDI_VLOG(3) << "    -> dims: " << delta_->Dim();
-        }
+            if(config.cfg_delta != "") {
+                KALDI_VLOG(3) << "Feature DELTA";
+                prev_feature = delta_ = new OnlineDeltaFeature(config.delta_opts, prev_feature);
+                KALDI_VLOG(3) << "    -> dims: " << delta_->Dim();
+            }
 
-        if(config.use_lda) {
-            KALDI_VLOG(3) << "Feature LDA " << config.lda_mat->NumRows() << " " << config.lda_mat->NumCols();
-            prev_feature = transform_lda_ = new OnlineTransform(*config.lda_mat, prev_feature);
-            KALDI_VLOG(3) << "    -> dims: " << transform_lda_->Dim();
-        }
+            if(config.use_lda) {
+                KALDI_VLOG(3) << "Feature LDA " << config.lda_mat->NumRows() << " " << config.lda_mat->NumCols();
+                prev_feature = transform_lda_ = new OnlineTransform(*config.lda_mat, prev_feature);
+                KALDI_VLOG(3) << "    -> dims: " << transform_lda_->Dim();
+            }
         
-        if(config.spkrID != "" && config.spkrID!="None" && config.spkrID!="NoSpkrID") {
-            KALDI_VLOG(3) << "Transform matrix for the speaker " << config.spkrID << " is of size " << config.spkr_mat->NumRows() << " " << config.spkr_mat->NumCols();
-            prev_feature = transform_spkr_ = new OnlineTransform(*config.spkr_mat, prev_feature);
-            KALDI_VLOG(3) << "    -> dims: " << transform_spkr_->Dim();
+            if(session.HasSpkrTransform()) {
+                KALDI_VLOG(3) << "Transform matrix for the speaker " << session.spkrID << " is of size " << session.spkr_mat->NumRows() << " " << session.spkr_mat->NumCols();
+                prev_feature = transform_spkr_ = new OnlineTransform(*session.spkr_mat, prev_feature);
+                KALDI_VLOG(3) << "    -> dims: " << transform_spkr_->Dim();
+            }
         }
 
         if (config.use_ivectors) {
             KALDI_VLOG(3) << "Feature IVectors";
             ivector_ = new OnlineIvectorFeature(*config.ivector_extraction_info, base_feature_);
+            if(adaptation_state != NULL && adaptation_state->ivector_state != NULL) {
+                ivector_->SetAdaptationState(*adaptation_state->ivector_state);
+            }
             prev_feature = ivector_append_ = new OnlineAppendFeature(prev_feature, ivector_);
             KALDI_VLOG(3) << "     -> dims: " << prev_feature->Dim();
         }
@@ -88,6 +200,8 @@ namespace alex_asr {
     }
 
     FeaturePipeline::~FeaturePipeline() {
+        delete resampler_;
+        resampler_ = NULL;
         delete base_feature_;
         base_feature_ = NULL;
         delete cmvn_;
@@ -102,6 +216,8 @@ namespace alex_asr {
         transform_lda_ = NULL;
         delete transform_spkr_;
         transform_spkr_ = NULL;
+        delete splice_transform_;
+        splice_transform_ = NULL;
         delete ivector_;
         ivector_ = NULL;
         delete ivector_append_;
@@ -120,13 +236,38 @@ namespace alex_asr {
 
     void FeaturePipeline::AcceptWaveform(BaseFloat sampling_rate,
                                                  const VectorBase<BaseFloat> &waveform) {
-        base_feature_->AcceptWaveform(sampling_rate, waveform);
+        if(sampling_rate != input_samp_freq_) {
+            KALDI_ERR << "Sampling frequency mismatch, expected " << input_samp_freq_
+                      << ", got " << sampling_rate;
+        }
+
+        if(resampler_) {
+            Vector<BaseFloat> resampled;
+            resampler_->Resample(waveform, false, &resampled);
+            AcceptResampledWaveform(resampled);
+        } else {
+            AcceptResampledWaveform(waveform);
+        }
+    }
+
+    void FeaturePipeline::AcceptResampledWaveform(const VectorBase<BaseFloat> &waveform) {
+        if(waveform.Dim() == 0)
+            return;
+
+        base_feature_->AcceptWaveform(samp_freq_, waveform);
         if(pitch_) {
-            pitch_->AcceptWaveform(sampling_rate, waveform);
+            pitch_->AcceptWaveform(samp_freq_, waveform);
         }
     }
 
     void FeaturePipeline::InputFinished() {
+        if(resampler_) {
+            // Flush the samples held back by the resampling filter.
+            Vector<BaseFloat> empty, resampled;
+            resampler_->Resample(empty, true, &resampled);
+            AcceptResampledWaveform(resampled);
+        }
+
         base_feature_->InputFinished();
         if(pitch_) {
             pitch_->InputFinished();
@@ -136,5 +277,26 @@ namespace alex_asr {
     OnlineIvectorFeature *FeaturePipeline::GetIvectorFeature() {
         return ivector_;
     }
+
+    void FeaturePipeline::GetAdaptationState(AdaptationState *adaptation_state) {
+        if(ivector_) {
+            if(adaptation_state->ivector_state == NULL) {
+                adaptation_state->ivector_state = new OnlineIvectorExtractorAdaptationState(*ivector_info_);
+            }
+            ivector_->GetAdaptationState(adaptation_state->ivector_state);
+        }
+
+        if(cmvn_) {
+            if(adaptation_state->cmvn_state == NULL) {
+                adaptation_state->cmvn_state = new OnlineCmvnState(*cmvn_state_);
+            }
+            int32 frame = cmvn_->NumFramesReady() - 1;
+            if(frame >= 0) {
+                cmvn_->GetState(frame, adaptation_state->cmvn_state);
+            } else {
+                *adaptation_state->cmvn_state = *cmvn_state_;
+            }
+        }
+    }
 }
 
@@ -2,20 +2,49 @@
 #define ALEX_ASR_FEATURE_PIPELINE_H
 
 #include "decoder_config.h"
+#include "feat/resample.h"
+#include "src/async_feature.h"
+#include "src/fast_feature.h"
+#include "src/parallel_feature.h"
 
 using namespace kaldi;
 
 namespace alex_asr {
+    // Speaker adaptation state that can be carried over from one utterance
+    // to the next one of the same speaker.
+    struct AdaptationState {
+        AdaptationState();
+        ~AdaptationState();
+
+        void Write(std::ostream &os, bool binary) const;
+        // The ivector extraction info is needed to read an ivector state;
+        // it may be NULL for models without ivectors.
+        void Read(std::istream &is, bool binary, const OnlineIvectorExtractionInfo *ivector_info);
+
+        OnlineIvectorExtractorAdaptationState *ivector_state;
+        OnlineCmvnState *cmvn_state;
+    private:
+        KALDI_DISALLOW_COPY_AND_ASSIGN(AdaptationState);
+    };
+
     class FeaturePipeline {
     public:
-        FeaturePipeline(DecoderConfig & config);
+        FeaturePipeline(DecoderConfig & config, SessionConfig &session,
+                        const AdaptationState *adaptation_state = NULL);
         ~FeaturePipeline();
         OnlineFeatureInterface *GetFeature();
         void AcceptWaveform(BaseFloat sampling_rate,
                             const VectorBase<BaseFloat> &waveform);
         void InputFinished();
         OnlineIvectorFeature* GetIvectorFeature();
+        void GetAdaptationState(AdaptationState *adaptation_state);
     private:
+        void AcceptResampledWaveform(const VectorBase<BaseFloat> &waveform);
+
+        BaseFloat samp_freq_;
+        BaseFloat input_samp_freq_;
+        LinearResample *resampler_;
+
         OnlineBaseFeature *base_feature_;
         OnlineCmvn *cmvn_;
         OnlineCmvnState *cmvn_state_;
@@ -23,13 +52,15 @@ namespace alex_asr {
         OnlineDeltaFeature *delta_;
         OnlineTransform *transform_lda_;
         OnlineTransform *transform_spkr_;
+        OnlineSpliceTransform *splice_transform_;
         OnlineIvectorFeature *ivector_;
         OnlineAppendFeature *ivector_append_;
-        OnlinePitchFeature *pitch_;
+        OnlineBaseFeature *pitch_;
         OnlineProcessPitch *pitch_feature_;
         OnlineAppendFeature *pitch_append_;
 
         OnlineFeatureInterface *final_feature_;
+        const OnlineIvectorExtractionInfo *ivector_info_;
     };
 }
 
@@ -0,0 +1,247 @@
+#include "src/final_result.h"
+#include "src/decoder.h"
+#include "src/utils.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    FinalResult::FinalResult(DecoderModel *model, LatticeFasterOnlineDecoder *search, bool best_path_only) :
+            model_(model),
+            search_(search),
+            best_path_only_(best_path_only),
+            ref_count_(1),
+            ready_(false),
+            num_frames_(0),
+            best_path_ok_(false),
+            best_path_prob_(-1.0f),
+            lattice_ok_(false),
+            lattice_tot_lik_(0.0),
+            alignment_ok_(false)
+    {
+        model_->Ref();
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&ready_cond_, NULL);
+    }
+
+    FinalResult::~FinalResult() {
+        delete search_;
+        search_ = NULL;
+        pthread_cond_destroy(&ready_cond_);
+        pthread_mutex_destroy(&mutex_);
+        model_->Unref();
+        model_ = NULL;
+    }
+
+    void FinalResult::Ref() {
+        pthread_mutex_lock(&mutex_);
+        ref_count_++;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void FinalResult::Unref() {
+        pthread_mutex_lock(&mutex_);
+        bool last = (--ref_count_ == 0);
+        pthread_mutex_unlock(&mutex_);
+
+        if(last) {
+            delete this;
+        }
+    }
+
+    bool FinalResult::Ready() {
+        pthread_mutex_lock(&mutex_);
+        bool ready = ready_;
+        pthread_mutex_unlock(&mutex_);
+        return ready;
+    }
+
+    void FinalResult::Wait() {
+        pthread_mutex_lock(&mutex_);
+        while(!ready_) {
+            pthread_cond_wait(&ready_cond_, &mutex_);
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void FinalResult::WaitForResults() {
+        Wait();
+        if(error_ != "") {
+            KALDI_ERR << "Computing the final result failed: " << error_;
+        }
+    }
+
+    bool FinalResult::GetBestPath(std::vector<int> *words, BaseFloat *prob) {
+        WaitForResults();
+        *words = best_path_words_;
+        *prob = best_path_prob_;
+        return best_path_ok_;
+    }
+
+    bool FinalResult::GetLattice(fst::VectorFst<fst::LogArc> *fst_out, double *tot_lik) {
+        WaitForResults();
+        if(num_frames_ == 0) {
+            KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+        }
+        *fst_out = lattice_;
+        *tot_lik = lattice_tot_lik_;
+        return lattice_ok_;
+    }
+
+    bool FinalResult::GetTimeAlignment(std::vector<int> *words, std::vector<int> *times,
+                                       std::vector<int> *lengths) {
+        WaitForResults();
+        *words = words_;
+        *times = times_;
+        *lengths = lengths_;
+        return alignment_ok_;
+    }
+
+    bool FinalResult::GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times,
+                                                         std::vector<int> *lengths, std::vector<float> *confs) {
+        WaitForResults();
+        *words = words_;
+        *times = times_;
+        *lengths = lengths_;
+        *confs = confs_;
+        return alignment_ok_;
+    }
+
+    int32 FinalResult::NumFramesDecoded() {
+        WaitForResults();
+        return num_frames_;
+    }
+
+    void FinalResult::Compute() {
+        try {
+            // The same steps as the getters of Decoder for the main graph,
+            // but one GetSearchResults() determinizes and rescores the
+            // lattice for all of them.
+            const DecoderConfig *config = model_->config;
+            num_frames_ = search_->NumFramesDecoded() - search_->StartFrame();
+
+            // Without frames there is no best path either (BestPathEnd()
+            // asserts); the results stay empty and not ok.
+            if(num_frames_ > 0) {
+                Lattice best_path_lat;
+                LatticeWeight weight;
+                best_path_ok_ = search_->GetBestPath(&best_path_lat);
+                fst::GetLinearSymbolSequence(best_path_lat,
+                                             static_cast<std::vector<int32> *>(0),
+                                             &best_path_words_,
+                                             &weight);
+                best_path_prob_ = weight.Value1() + weight.Value2();
+
+                CompactLattice compact_lat;
+                alignment_ok_ = GetSearchResults(*model_, search_, best_path_only_, true, true,
+                                                 &compact_lat, &lattice_ok_,
+                                                 &words_, &times_, &lengths_, &confs_);
+                lattice_tot_lik_ = CompactLatticeToWordsPost(compact_lat, &lattice_, config->post_opts);
+            }
+        } catch(const std::exception &e) {
+            error_ = e.what();
+        }
+
+        pthread_mutex_lock(&mutex_);
+        ready_ = true;
+        pthread_cond_broadcast(&ready_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    LatticeFasterOnlineDecoder *FinalResult::ReleaseSearch() {
+        LatticeFasterOnlineDecoder *search = search_;
+        search_ = NULL;
+        return search;
+    }
+
+    FinalizeWorker::FinalizeWorker() :
+            search_(NULL),
+            search_generation_(0),
+            stop_(false)
+    {
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&work_cond_, NULL);
+        if(pthread_create(&thread_, NULL, &FinalizeWorker::RunWorker, this) != 0) {
+            pthread_cond_destroy(&work_cond_);
+            pthread_mutex_destroy(&mutex_);
+            KALDI_ERR << "Could not start the finalization thread.";
+        }
+    }
+
+    FinalizeWorker::~FinalizeWorker() {
+        pthread_mutex_lock(&mutex_);
+        stop_ = true;
+        pthread_cond_signal(&work_cond_);
+        pthread_mutex_unlock(&mutex_);
+        pthread_join(thread_, NULL);
+
+        delete search_;
+        search_ = NULL;
+        pthread_cond_destroy(&work_cond_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    void FinalizeWorker::Push(FinalResult *result) {
+        result->Ref();
+        pthread_mutex_lock(&mutex_);
+        queue_.push_back(std::make_pair(result, search_generation_));
+        pthread_cond_signal(&work_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    LatticeFasterOnlineDecoder *FinalizeWorker::TakeSearch() {
+        pthread_mutex_lock(&mutex_);
+        LatticeFasterOnlineDecoder *search = search_;
+        search_ = NULL;
+        pthread_mutex_unlock(&mutex_);
+        return search;
+    }
+
+    void FinalizeWorker::DropSearches() {
+        pthread_mutex_lock(&mutex_);
+        search_generation_++;
+        LatticeFasterOnlineDecoder *search = search_;
+        search_ = NULL;
+        pthread_mutex_unlock(&mutex_);
+
+        delete search;
+    }
+
+    void *FinalizeWorker::RunWorker(void *self) {
+        static_cast<FinalizeWorker *>(self)->Worker();
+        return NULL;
+    }
+
+    void FinalizeWorker::Worker() {
+        pthread_mutex_lock(&mutex_);
+        while(true) {
+            while(queue_.empty() && !stop_) {
+                pthread_cond_wait(&work_cond_, &mutex_);
+            }
+            // Pending results are computed before stopping; their callers
+            // may still be waiting for them.
+            if(queue_.empty()) {
+                break;
+            }
+            FinalResult *result = queue_.front().first;
+            int32 generation = queue_.front().second;
+            queue_.pop_front();
+            pthread_mutex_unlock(&mutex_);
+
+            result->Compute();
+            LatticeFasterOnlineDecoder *search = result->ReleaseSearch();
+            result->Unref();
+
+            pthread_mutex_lock(&mutex_);
+            // The decoder takes one search per utterance, so one is enough;
+            // a second one would only hold on to its pools.
+            if(generation == search_generation_ && search_ == NULL) {
+                search_ = search;
+            } else {
+                pthread_mutex_unlock(&mutex_);
+                delete search;
+                pthread_mutex_lock(&mutex_);
+            }
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+}
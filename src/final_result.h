@@ -0,0 +1,113 @@
+#ifndef ALEX_ASR_FINAL_RESULT_H_
+#define ALEX_ASR_FINAL_RESULT_H_
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fst/fstlib.h"
+#include "src/decoder_model.h"
+#include "src/lattice_faster_online_decoder.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Final results of the main graph of an utterance handed over by
+    // Decoder::FinalizeDecodingAsync(). They are computed on a worker thread
+    // from the finalized search, which the result owns until then; the
+    // getters wait for them and return what the getters of Decoder would
+    // have returned after FinalizeDecoding(). The instance is reference
+    // counted, like DecoderModel; the caller must Unref() it.
+    class FinalResult {
+    public:
+        // Takes ownership of the finalized search; keeps a reference to model.
+        FinalResult(DecoderModel *model, LatticeFasterOnlineDecoder *search, bool best_path_only);
+
+        void Ref();
+        void Unref();
+
+        bool Ready();
+        void Wait();
+
+        bool GetBestPath(std::vector<int> *words, BaseFloat *prob);
+        bool GetLattice(fst::VectorFst<fst::LogArc> *fst_out, double *tot_lik);
+        bool GetTimeAlignment(std::vector<int> *words, std::vector<int> *times, std::vector<int> *lengths);
+        bool GetTimeAlignmentWithWordConfidence(std::vector<int> *words, std::vector<int> *times,
+                                                std::vector<int> *lengths, std::vector<float> *confs);
+        // Frames of the utterance decoded by the search.
+        int32 NumFramesDecoded();
+
+        // Computes the results; called once by the worker.
+        void Compute();
+        // Hands the search over to the caller once the results are
+        // computed, so that its pools serve another utterance.
+        LatticeFasterOnlineDecoder *ReleaseSearch();
+    private:
+        ~FinalResult();
+        // Waits for the results; throws if computing them failed.
+        void WaitForResults();
+
+        DecoderModel *model_;
+        LatticeFasterOnlineDecoder *search_;
+        bool best_path_only_;
+
+        int32 ref_count_;
+        pthread_mutex_t mutex_;
+        pthread_cond_t ready_cond_;
+        bool ready_;
+        std::string error_;
+
+        int32 num_frames_;
+        bool best_path_ok_;
+        std::vector<int> best_path_words_;
+        BaseFloat best_path_prob_;
+        bool lattice_ok_;
+        fst::VectorFst<fst::LogArc> lattice_;
+        double lattice_tot_lik_;
+        bool alignment_ok_;
+        std::vector<int> words_;
+        std::vector<int> times_;
+        std::vector<int> lengths_;
+        std::vector<float> confs_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(FinalResult);
+    };
+
+    // Thread computing the FinalResults of one decoder in the order they
+    // were pushed. The destructor computes the pending ones first. The
+    // searches of the computed results are kept for the decoder, which
+    // starts its next utterances on them instead of on empty pools; one
+    // is kept at a time.
+    class FinalizeWorker {
+    public:
+        FinalizeWorker();
+        ~FinalizeWorker();
+
+        // Adds a reference to result until it is computed.
+        void Push(FinalResult *result);
+        // A search of a computed result, to be started again with
+        // InitDecoding(); NULL if there is none yet. The caller owns it.
+        LatticeFasterOnlineDecoder *TakeSearch();
+        // Deletes the kept search; those of the results pushed so far are
+        // deleted once computed. For when the graph they search goes away.
+        void DropSearches();
+    private:
+        static void *RunWorker(void *self);
+        void Worker();
+
+        pthread_t thread_;
+        pthread_mutex_t mutex_;
+        pthread_cond_t work_cond_;
+        // Pushed results with the search_generation_ of their push.
+        std::deque<std::pair<FinalResult *, int32> > queue_;
+        LatticeFasterOnlineDecoder *search_;  // Kept for TakeSearch(); NULL if none.
+        int32 search_generation_;  // Incremented by DropSearches().
+        bool stop_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(FinalizeWorker);
+    };
+}
+
+#endif  // ALEX_ASR_FINAL_RESULT_H_
@@ -0,0 +1,462 @@
+// Copyright 2009-2013  Microsoft Corporation;  Mirko Hannemann;
+//           2013-2014  Johns Hopkins University (Author: Daniel Povey)
+//                2014  Guoguo Chen
+//                2014  IMSL, PKU-HKUST (author: Wei Shi)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This is Kaldi's LatticeFasterOnlineDecoder, modified to allocate its tokens
+// and forward links from per-decoder memory pools that are recycled across
+// utterances instead of from the global heap.
+
+#ifndef ALEX_ASR_LATTICE_FASTER_ONLINE_DECODER_H_
+#define ALEX_ASR_LATTICE_FASTER_ONLINE_DECODER_H_
+
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "util/stl-utils.h"
+#include "util/hash-list.h"
+#include "fst/fstlib.h"
+#include "itf/decodable-itf.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "decoder/lattice-faster-decoder.h"  // for LatticeFasterDecoderConfig
+#include "online2/online-endpoint.h"
+#include "src/memory_pool.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+
+    struct DecoderPoolOptions {
+        // Number of tokens (or links) allocated at once.
+        int32 block_size;
+        // Memory kept by the pools between utterances; when the pools of a
+        // decoder grow larger, they are returned to the heap at the start of
+        // the next utterance.
+        int32 max_mb;
+
+        DecoderPoolOptions() : block_size(1024), max_mb(64) { }
+    };
+
+    struct DecoderPoolStats {
+        int64 tokens_used;
+        int64 tokens_allocated;
+        int64 links_used;
+        int64 links_allocated;
+        int64 bytes;
+
+        DecoderPoolStats() : tokens_used(0), tokens_allocated(0), links_used(0),
+                             links_allocated(0), bytes(0) { }
+    };
+
+    class LatticeFasterOnlineDecoder {
+    public:
+        typedef fst::StdArc Arc;
+        typedef Arc::Label Label;
+        typedef Arc::StateId StateId;
+        typedef Arc::Weight Weight;
+
+        struct BestPathIterator {
+            void *tok;
+            int32 frame;
+            // note, "frame" is the frame-index of the frame you'll get the
+            // transition-id for next time, if you call TraceBackBestPath on this
+            // iterator (assuming it's not an epsilon transition).  Note that this
+            // is one less than you might reasonably expect, e.g. it's -1 for
+            // the nonemitting transitions before the first frame.
+            BestPathIterator(void *t, int32 f) : tok(t), frame(f) { }
+            bool Done() { return tok == NULL; }
+        };
+
+        // instantiate this class once for each thing you have to decode.
+        LatticeFasterOnlineDecoder(const fst::StdFst &fst,
+                                   const LatticeFasterDecoderConfig &config,
+                                   const DecoderPoolOptions &pool_opts = DecoderPoolOptions());
+
+        void SetOptions(const LatticeFasterDecoderConfig &config) { config_ = config; }
+
+        const LatticeFasterDecoderConfig &GetOptions() const { return config_; }
+
+        ~LatticeFasterOnlineDecoder();
+
+        // Says whether a final-state was active on the last frame.
+        bool ReachedFinal() const {
+            return FinalRelativeCost() != std::numeric_limits<BaseFloat>::infinity();
+        }
+
+        // Outputs an FST corresponding to the single best path through the
+        // lattice.  Returns true if result is nonempty (using the return status
+        // is deprecated, it will become void).  If "use_final_probs" is true AND
+        // we reached the final-state of the graph then it will include those as
+        // final-probs, else it will treat all final-probs as one.  Outputs an
+        // empty FST and returns false if no frames were decoded.
+        bool GetBestPath(Lattice *ofst, bool use_final_probs = true) const;
+
+        // This function returns an iterator that can be used to trace back
+        // the best path.  If use_final_probs == true and at least one final
+        // state survived till the end, it will use the final-probs in working
+        // out the best final Token, and will output the final cost to
+        // *final_cost (if non-NULL), else it will use only the forward
+        // likelihood, and will put zero in *final_cost (if non-NULL).
+        // Requires that NumFramesDecoded() > 0.
+        BestPathIterator BestPathEnd(bool use_final_probs,
+                                     BaseFloat *final_cost = NULL) const;
+
+        // This function can be used in conjunction with BestPathEnd() to trace
+        // back the best path one link at a time (e.g. this can be useful in
+        // endpoint detection).  By "link" we mean a link in the graph; not all
+        // links cross frame boundaries, but each time you see a nonzero ilabel
+        // you can interpret that as a frame.  The return value is the updated
+        // iterator.  It outputs the ilabel and olabel, and the (graph and
+        // acoustic) weight to the "arc" pointer, while leaving its "nextstate"
+        // variable unchanged.
+        BestPathIterator TraceBackBestPath(BestPathIterator iter, LatticeArc *arc) const;
+
+        // Outputs the words of the current best path (without final-probs,
+        // unless decoding was finalized), and in *num_stable the length of
+        // its prefix that is shared by the best-path history of every token
+        // on the last frame; that prefix will not change any more (after
+        // FinalizeDecoding() that is all of it). Requires that
+        // NumFramesDecoded() > 0. Only the best path after the previous
+        // stable point is traced back.
+        void GetPartialResult(std::vector<int32> *words, int32 *num_stable) const;
+
+        // Like GetPartialResult(), and returns the point of the best path
+        // where the stable prefix ends: the latest token that lies on the
+        // best-path history of every token on the last frame.
+        BestPathIterator GetStablePoint(std::vector<int32> *words, int32 *num_stable) const;
+
+        // Frees the tokens and links before the given stable point (see
+        // GetStablePoint()), which becomes the start of the lattice; the
+        // hypotheses of the dropped part are the stable prefix. Frame numbers
+        // stay those of the whole utterance (NumFramesDecoded(), the frames
+        // asked from the decodable), while the lattices and best-path
+        // iterators count frames from the point; see FrameOffset().
+        void DiscardHistory(const BestPathIterator &point);
+
+        // Outputs an FST corresponding to the raw, state-level
+        // tracebacks.  Returns true if result is nonempty.
+        // If "use_final_probs" is true AND we reached the final-state
+        // of the graph then it will include those as final-probs, else
+        // it will treat all final-probs as one.
+        bool GetRawLattice(Lattice *ofst, bool use_final_probs = true) const;
+
+        // InitDecoding initializes the decoding, and should only be used if you
+        // intend to call AdvanceDecoding().  The tokens of the previous
+        // utterance go back to the pools.  The search starts at frame
+        // start_frame of the decodable, e.g. right after the previous segment
+        // of a stream that goes on.
+        void InitDecoding(int32 start_frame = 0);
+
+        // This will decode until there are no more frames ready in the
+        // decodable object, but if max_num_frames is >= 0 it will decode no
+        // more than that many frames.
+        void AdvanceDecoding(DecodableInterface *decodable, int32 max_num_frames = -1);
+
+        // This function may be optionally called after AdvanceDecoding(), when
+        // you do not plan to decode any further.  It does an extra pruning step
+        // that will help to prune the lattices output by GetRawLattice more
+        // accurately, particularly toward the end of the utterance.  It does
+        // this by using the final-probs in pruning (if any final-state survived);
+        // it also does a final pruning step that visits all states (the
+        // pruning that is done during decoding may fail to prune states that
+        // are within kPruningScale = 0.1 outside of the beam).  If you call
+        // this, you cannot call AdvanceDecoding again (it will fail), and you
+        // cannot call GetRawLattice() and related functions with
+        // use_final_probs = false.
+        void FinalizeDecoding();
+
+        // FinalRelativeCost() serves the same function as ReachedFinal(), but
+        // gives more information.  It returns the difference between the best
+        // (final-cost plus cost) of any token on the final frame, and the best
+        // cost of any token on the final frame.  If it is infinity it means no
+        // final-states were present on the final frame.  It will usually be
+        // nonnegative.  If it not too positive (e.g. < 5 is my first guess, but
+        // this is not tested) you can take it as a good indication that we
+        // reached the final-state with reasonable likelihood.
+        BaseFloat FinalRelativeCost() const;
+
+        // Returns the number of frames decoded so far, counted from frame 0 of
+        // the decodable (so including StartFrame()).  The value returned
+        // changes whenever we call ProcessEmitting().
+        inline int32 NumFramesDecoded() const { return frame_offset_ + active_toks_.size() - 1; }
+
+        // Frame of the decodable at which the search started; see InitDecoding().
+        inline int32 StartFrame() const { return start_frame_; }
+
+        // The start frame plus the frames dropped by DiscardHistory(); frame t
+        // of the lattices is frame FrameOffset() + t of the decodable.
+        inline int32 FrameOffset() const { return frame_offset_; }
+
+        void GetPoolStats(DecoderPoolStats *stats) const;
+    private:
+        // ForwardLinks are the links from a token to a token on the next frame.
+        // or sometimes on the current frame (for input-epsilon links).
+        struct Token;
+        struct ForwardLink {
+            Token *next_tok;  // the next token [or NULL if represents final-state]
+            Label ilabel;  // ilabel on link.
+            Label olabel;  // olabel on link.
+            BaseFloat graph_cost;  // graph cost of traversing link (contains LM, etc.)
+            BaseFloat acoustic_cost;  // acoustic cost (pre-scaled) of traversing link
+            ForwardLink *next;  // next in singly-linked list of forward links from a
+                                // token.
+            inline ForwardLink(Token *next_tok, Label ilabel, Label olabel,
+                               BaseFloat graph_cost, BaseFloat acoustic_cost,
+                               ForwardLink *next) :
+                    next_tok(next_tok), ilabel(ilabel), olabel(olabel),
+                    graph_cost(graph_cost), acoustic_cost(acoustic_cost),
+                    next(next) { }
+        };
+
+        // Token is what's resident in a particular state at a particular time.
+        // In this decoder a Token actually contains *forward* links.
+        // When first created, a Token just has the (total) cost.    We add forward
+        // links from it when we process the next frame.
+        struct Token {
+            BaseFloat tot_cost;  // would equal weight.Value()... cost up to point.
+            BaseFloat extra_cost;  // >= 0.  After calling PruneForwardLinks, this equals
+            // the minimum difference between the cost of the best path, and the cost of
+            // this is on, and the cost of the absolute best path, under the assumption
+            // that any of the currently active states at the decoding front may
+            // eventually succeed (e.g. if you were to take the currently active states
+            // one by one and compute this difference, and then take the minimum).
+
+            ForwardLink *links;  // Head of singly linked list of ForwardLinks
+
+            Token *next;  // Next in list of tokens for this frame.
+
+            Token *backpointer;  // best preceding Token (could be on this frame or a
+            // previous frame).  This is only required for an
+            // efficient GetBestPath function, it plays no part in
+            // the lattice generation (the "links" list is what
+            // stores the forward links, for that).
+
+            inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
+                         Token *next, Token *backpointer) :
+                    tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
+                    backpointer(backpointer) { }
+        };
+
+        typedef HashList<StateId, Token *>::Elem Elem;
+
+        inline Token *NewToken(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
+                               Token *next, Token *backpointer) {
+            return new (token_pool_.Allocate()) Token(tot_cost, extra_cost, links, next, backpointer);
+        }
+
+        inline void DeleteToken(Token *tok) {
+            token_pool_.Free(tok);
+        }
+
+        inline ForwardLink *NewForwardLink(Token *next_tok, Label ilabel, Label olabel,
+                                           BaseFloat graph_cost, BaseFloat acoustic_cost,
+                                           ForwardLink *next) {
+            return new (link_pool_.Allocate()) ForwardLink(next_tok, ilabel, olabel,
+                                                           graph_cost, acoustic_cost, next);
+        }
+
+        inline void DeleteForwardLink(ForwardLink *link) {
+            link_pool_.Free(link);
+        }
+
+        // Deletes all the forward links of the token.
+        inline void DeleteForwardLinks(Token *tok) {
+            ForwardLink *l = tok->links, *m;
+            while (l != NULL) {
+                m = l->next;
+                DeleteForwardLink(l);
+                l = m;
+            }
+            tok->links = NULL;
+        }
+
+        void PossiblyResizeHash(size_t num_toks);
+
+        // TokenList is a structure used to store the list of tokens for a single
+        // frame, together with flags telling us whether the forward links and the
+        // tokens need to be pruned.
+        struct TokenList {
+            Token *toks;
+            bool must_prune_forward_links;
+            bool must_prune_tokens;
+            TokenList() : toks(NULL), must_prune_forward_links(true),
+                          must_prune_tokens(true) { }
+        };
+
+        // FindOrAddToken either locates a token in hash of toks_, or if necessary
+        // inserts a new, empty token (i.e. with no forward links) for the current
+        // frame.  [note: it's inserted if necessary into hash toks_ and also into
+        // the singly linked list of tokens active on this frame (whose head is at
+        // active_toks_[frame]).  The frame_plus_one argument is the acoustic frame
+        // index plus one, which is used to index into the active_toks_ array.
+        // Returns the Token pointer.  Sets "changed" (if non-NULL) to true if the
+        // token was newly created or the cost changed.
+        inline Token *FindOrAddToken(StateId state, int32 frame_plus_one,
+                                     BaseFloat tot_cost, Token *backpointer,
+                                     bool *changed);
+
+        // prunes outgoing links for all tokens in active_toks_[frame]
+        // it's called by PruneActiveTokens
+        // all links, that have link_extra_cost > lattice_beam are pruned
+        // delta is the amount by which the extra_costs must change
+        // before we set *extra_costs_changed = true.
+        // If delta is larger,  we'll tend to go back less far
+        //    toward the beginning of the file.
+        // extra_costs_changed is set to true if extra_cost was changed for any token
+        // links_pruned is set to true if any link in any token was pruned
+        void PruneForwardLinks(int32 frame_plus_one, bool *extra_costs_changed,
+                               bool *links_pruned,
+                               BaseFloat delta);
+
+        // This function computes the final-costs for tokens active on the final
+        // frame.  It outputs to final-costs, if non-NULL, a map from the Token*
+        // pointer to the final-prob of the corresponding state, for all Tokens
+        // that correspond to states that have final-probs.  This map will be
+        // empty if there were no final-probs.  It outputs to
+        // final_relative_cost, if non-NULL, the difference between the best
+        // forward-cost including the final-prob cost, and the best forward-cost
+        // without including the final-prob cost (this will usually be positive),
+        // or infinity if there were no final-probs.  [c.f. FinalRelativeCost(),
+        // which outputs this quanitity].  It outputs to final_best_cost, if
+        // non-NULL, the lowest for any token t active on the final frame, of
+        // forward-cost[t] + final-cost[t], where final-cost[t] is the final-cost
+        // in the graph of the state corresponding to token t, or the best of
+        // forward-cost[t] if there were no final-probs active on the final frame.
+        // You cannot call this after FinalizeDecoding() has been called; in that
+        // case you should get the answer from class-member variables.
+        void ComputeFinalCosts(unordered_map<Token *, BaseFloat> *final_costs,
+                               BaseFloat *final_relative_cost,
+                               BaseFloat *final_best_cost) const;
+
+        // PruneForwardLinksFinal is a version of PruneForwardLinks that we call
+        // on the final frame.  If there are final tokens active, it uses
+        // the final-probs for pruning, otherwise it treats all tokens as final.
+        void PruneForwardLinksFinal();
+
+        // Prune away any tokens on this frame that have no forward links.
+        // [we don't do this in PruneForwardLinks because it would give us
+        // a problem with dangling pointers].
+        // It's called by PruneActiveTokens if any forward links have been pruned
+        void PruneTokensForFrame(int32 frame_plus_one);
+
+        // Go backwards through still-alive tokens, pruning them if the
+        // forward+backward cost is more than lat_beam away from the best path.  It's
+        // possible to prove that this is "correct" in the sense that we won't lose
+        // anything outside of lat_beam, regardless of what happens in the future.
+        // delta controls when it considers a cost to have changed enough to continue
+        // going backward and propagating the change.  larger delta -> will recurse
+        // less far.
+        void PruneActiveTokens(BaseFloat delta);
+
+        // Gets the weight cutoff.  Also counts the active tokens.
+        BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
+                            BaseFloat *adaptive_beam, Elem **best_elem);
+
+        // Processes emitting arcs for one frame.  Propagates from prev_toks_ to
+        // cur_toks_.  Returns the cost cutoff for subsequent ProcessNonemitting() to
+        // use.
+        BaseFloat ProcessEmitting(DecodableInterface *decodable);
+
+        // Processes nonemitting (epsilon) arcs for one frame.  Called after
+        // ProcessEmitting() on each frame.  The cost cutoff is computed by the
+        // preceding ProcessEmitting().
+        void ProcessNonemitting(BaseFloat cost_cutoff);
+
+        // HashList defined in ../util/hash-list.h.  It actually allows us to
+        // maintain more than one list (e.g. for current and previous frames), but
+        // only one of them at a time can be indexed by StateId.  It is indexed by
+        // frame-index plus one, where the frame-index is zero-based, as used in
+        // decodable object.  That is, the emitting probs of frame t are accounted
+        // for in tokens at toks_[t+1].  The zeroth frame is for nonemitting
+        // transition at the start of the graph.
+        HashList<StateId, Token *> toks_;
+
+        std::vector<TokenList> active_toks_;  // Lists of tokens, indexed by
+        // frame (members of TokenList are toks, must_prune_forward_links,
+        // must_prune_tokens), counted from frame_offset_.
+        std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
+        std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+        // make it class member to avoid internal new/delete.
+        const fst::StdFst &fst_;
+        LatticeFasterDecoderConfig config_;
+        DecoderPoolOptions pool_opts_;
+        MemoryPool token_pool_;
+        MemoryPool link_pool_;
+        int32 start_frame_;  // Frame given to InitDecoding(); see StartFrame().
+        int32 frame_offset_;  // Frames dropped by DiscardHistory(); see FrameOffset().
+        int32 num_toks_;  // current total #toks allocated...
+        bool warned_;
+
+        // decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
+        // calling this is optional].  If true, it's forbidden to decode more.  Also,
+        // if this is set, then the output of ComputeFinalCosts() is in the next
+        // three variables.  The reason we need to do this is that after
+        // FinalizeDecoding() calls PruneTokensForFrame() for the final frame, some
+        // of the tokens on the last frame are freed, so we free the list from toks_
+        // to avoid having dangling pointers hanging around.
+        bool decoding_finalized_;
+        // For the meaning of the next 3 variables, see the comment for
+        // decoding_finalized_ above., and ComputeFinalCosts().
+        unordered_map<Token *, BaseFloat> final_costs_;
+        BaseFloat final_relative_cost_;
+        BaseFloat final_best_cost_;
+
+        // Offsets added to the acoustic costs of each frame to keep them in a
+        // good dynamic range; subtracted again when the lattice is output.
+        std::vector<BaseFloat> cost_offsets_;
+
+        // The last stable point found by GetStablePoint() (tok is NULL if
+        // none yet) and the words up to it. The stable prefix never changes,
+        // so the next traceback stops at this point.
+        mutable BestPathIterator stable_point_;
+        mutable std::vector<int32> stable_words_;
+
+        // This function takes a singly linked list of tokens for a single frame, and
+        // outputs a list of them in topological order (it will crash if no such order
+        // can be found, which will typically be due to decoding graphs with epsilon
+        // cycles, which are not allowed).  Note: the output list may contain NULLs,
+        // which the caller should pass over; it just happens to be more efficient for
+        // the algorithm to output a list that contains NULLs.
+        static void TopSortTokens(Token *tok_list,
+                                  std::vector<Token *> *topsorted_list);
+
+        void DeleteElems(Elem *list);
+
+        void ClearActiveTokens();
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoder);
+    };
+
+    // Counts the frames of silence at the end of the current best path.
+    int32 TrailingSilenceLength(const TransitionModel &tmodel,
+                                const std::string &silence_phones,
+                                const LatticeFasterOnlineDecoder &decoder);
+
+    // Endpoint detection on the decoder above; see kaldi::EndpointDetected().
+    bool EndpointDetected(const OnlineEndpointConfig &config,
+                          const TransitionModel &tmodel,
+                          BaseFloat frame_shift_in_seconds,
+                          const LatticeFasterOnlineDecoder &decoder);
+
+}  // end namespace alex_asr.
+
+#endif  // ALEX_ASR_LATTICE_FASTER_ONLINE_DECODER_H_
@@ -0,0 +1,87 @@
+#include "src/lm_rescorer.h"
+
+#include "fstext/kaldi-fst-io.h"
+#include "fstext/table-matcher.h"
+#include "lat/lattice-functions.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    LatticeRescorer::LatticeRescorer(const std::string &old_lm_rxfilename,
+                                     const std::string &new_lm_rxfilename,
+                                     BaseFloat lm_scale) :
+            old_lm_fst_(NULL),
+            lm_scale_(lm_scale)
+    {
+        KALDI_VLOG(2) << "Loading rescoring LMs: " << old_lm_rxfilename << " " << new_lm_rxfilename;
+
+        old_lm_fst_ = fst::ReadFstKaldi(old_lm_rxfilename);
+        // Backoff arcs carry #0 on the input side; only the words matter.
+        fst::Project(old_lm_fst_, fst::PROJECT_OUTPUT);
+        if(old_lm_fst_->Properties(fst::kILabelSorted, true) == 0) {
+            fst::ILabelCompare<fst::StdArc> ilabel_comp;
+            fst::ArcSort(old_lm_fst_, ilabel_comp);
+        }
+
+        ReadKaldiObject(new_lm_rxfilename, &new_lm_);
+    }
+
+    LatticeRescorer::~LatticeRescorer() {
+        delete old_lm_fst_;
+        old_lm_fst_ = NULL;
+    }
+
+    bool LatticeRescorer::Rescore(CompactLattice *clat) const {
+        // The old LM interpreted in the lattice semiring, with all the cost
+        // on the graph part of the weight. The view caches the states it
+        // expands, so each call gets its own.
+        fst::CacheOptions cache_opts(true, 50000);
+        fst::StdToLatticeMapper<BaseFloat> mapper;
+        LatticeLmFst old_lm_lattice_fst(*old_lm_fst_, mapper, cache_opts);
+
+        // Remove the old LM scores: compose with the old LM scaled by -1.
+        Lattice lat;
+        ConvertLattice(*clat, &lat);
+        fst::ScaleLattice(fst::GraphLatticeScale(-1.0), &lat);
+        ArcSort(&lat, fst::OLabelCompare<LatticeArc>());
+
+        fst::TableComposeOptions compose_opts(fst::TableMatcherOptions(),
+                                              true, fst::SEQUENCE_FILTER,
+                                              fst::MATCH_INPUT);
+        fst::TableComposeCache<fst::Fst<LatticeArc> > lm_compose_cache(compose_opts);
+        Lattice composed_lat;
+        TableCompose(lat, old_lm_lattice_fst, &composed_lat, &lm_compose_cache);
+        Invert(&composed_lat);  // Word labels on the input side.
+
+        CompactLattice no_lm_clat;
+        DeterminizeLattice(composed_lat, &no_lm_clat);
+        fst::ScaleLattice(fst::GraphLatticeScale(-1.0), &no_lm_clat);
+        if(no_lm_clat.Start() == fst::kNoStateId) {
+            KALDI_WARN << "Empty lattice after removing the first pass LM scores.";
+            return false;
+        }
+
+        // Add the new LM scores.
+        fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), &no_lm_clat);
+        ArcSort(&no_lm_clat, fst::OLabelCompare<CompactLatticeArc>());
+
+        ConstArpaLmDeterministicFst new_lm_fst(new_lm_);
+        CompactLattice composed_clat;
+        ComposeCompactLatticeDeterministic(no_lm_clat, &new_lm_fst, &composed_clat);
+
+        Lattice rescored_lat;
+        ConvertLattice(composed_clat, &rescored_lat);
+        Invert(&rescored_lat);
+        CompactLattice rescored_clat;
+        DeterminizeLattice(rescored_lat, &rescored_clat);
+        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &rescored_clat);
+        if(rescored_clat.Start() == fst::kNoStateId) {
+            KALDI_WARN << "Empty lattice after rescoring with the second pass LM.";
+            return false;
+        }
+
+        *clat = rescored_clat;
+        return true;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef ALEX_ASR_LM_RESCORER_H_
+#define ALEX_ASR_LM_RESCORER_H_
+
+#include <string>
+
+#include "fstext/fstext-lib.h"
+#include "lat/kaldi-lattice.h"
+#include "lm/const-arpa-lm.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Second-pass rescoring of determinized lattices: the scores of the LM
+    // compiled into the decoding graph are removed and replaced by the scores
+    // of a (much larger) LM in Kaldi's const-arpa format.
+    class LatticeRescorer {
+    public:
+        LatticeRescorer(const std::string &old_lm_rxfilename,
+                        const std::string &new_lm_rxfilename,
+                        BaseFloat lm_scale);
+        ~LatticeRescorer();
+
+        // Returns false if the rescored lattice is empty; clat is left
+        // unchanged in that case. Safe to call from several threads.
+        bool Rescore(CompactLattice *clat) const;
+    private:
+        typedef fst::MapFst<fst::StdArc, LatticeArc, fst::StdToLatticeMapper<BaseFloat> > LatticeLmFst;
+
+        fst::VectorFst<fst::StdArc> *old_lm_fst_;
+        ConstArpaLm new_lm_;
+        BaseFloat lm_scale_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeRescorer);
+    };
+}
+
+#endif  // ALEX_ASR_LM_RESCORER_H_
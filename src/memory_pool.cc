@@ -0,0 +1,48 @@
+#include "src/memory_pool.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    MemoryPool::MemoryPool(size_t object_size, int32 block_size) :
+            block_size_(block_size),
+            free_list_(NULL),
+            num_used_(0)
+    {
+        KALDI_ASSERT(block_size > 0);
+        // Free objects hold the free list pointer; keep objects pointer aligned.
+        object_size_ = ((std::max(object_size, sizeof(void *)) + sizeof(void *) - 1) / sizeof(void *))
+                       * sizeof(void *);
+    }
+
+    MemoryPool::~MemoryPool() {
+        if(num_used_ != 0) {
+            KALDI_WARN << "Destroying a memory pool with " << num_used_ << " objects in use.";
+        }
+        for(size_t i = 0; i < blocks_.size(); i++) {
+            delete [] blocks_[i];
+        }
+    }
+
+    void MemoryPool::NewBlock() {
+        char *block = new char[object_size_ * block_size_];
+        blocks_.push_back(block);
+
+        // Thread the new objects onto the free list in address order.
+        for(int32 i = block_size_ - 1; i >= 0; i--) {
+            void *object = block + i * object_size_;
+            *static_cast<void **>(object) = free_list_;
+            free_list_ = object;
+        }
+    }
+
+    void MemoryPool::Release() {
+        if(num_used_ != 0) {
+            return;
+        }
+        for(size_t i = 0; i < blocks_.size(); i++) {
+            delete [] blocks_[i];
+        }
+        blocks_.clear();
+        free_list_ = NULL;
+    }
+}
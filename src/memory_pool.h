@@ -0,0 +1,55 @@
+#ifndef ALEX_ASR_MEMORY_POOL_H_
+#define ALEX_ASR_MEMORY_POOL_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Pool of fixed-size objects allocated in blocks. Freed objects go to a
+    // free list and are reused, so a long-lived pool reaches a steady state in
+    // which it does no heap allocation at all. Not thread-safe: meant to be
+    // owned by one decoder.
+    class MemoryPool {
+    public:
+        MemoryPool(size_t object_size, int32 block_size);
+        ~MemoryPool();
+
+        inline void *Allocate() {
+            if(free_list_ == NULL) {
+                NewBlock();
+            }
+            void *object = free_list_;
+            free_list_ = *static_cast<void **>(object);
+            num_used_++;
+            return object;
+        }
+
+        inline void Free(void *object) {
+            *static_cast<void **>(object) = free_list_;
+            free_list_ = object;
+            num_used_--;
+        }
+
+        // Returns all blocks to the heap if no object is in use.
+        void Release();
+
+        size_t NumUsed() const { return num_used_; }
+        size_t NumAllocated() const { return blocks_.size() * block_size_; }
+        size_t NumBytes() const { return NumAllocated() * object_size_; }
+    private:
+        void NewBlock();
+
+        size_t object_size_;
+        int32 block_size_;
+        std::vector<char *> blocks_;
+        void *free_list_;
+        size_t num_used_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryPool);
+    };
+}
+
+#endif  // ALEX_ASR_MEMORY_POOL_H_
@@ -0,0 +1,167 @@
+#include "src/parallel_feature.h"
+
+#include <pthread.h>
+
+#include "src/fast_feature.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    OnlineParallelFeature::OnlineParallelFeature(const DecoderConfig &config, int32 num_threads) :
+            config_(config),
+            frame_opts_(config.feature_type == DecoderConfig::MFCC ? config.mfcc_opts.frame_opts
+                                                                   : config.fbank_opts.frame_opts),
+            num_threads_(num_threads),
+            dim_(0),
+            sampling_rate_(0.0),
+            input_finished_(false)
+    {
+        KALDI_ASSERT(num_threads_ > 0);
+        KALDI_ASSERT(frame_opts_.snip_edges);
+        OnlineBaseFeature *feature = NewFeature();
+        dim_ = feature->Dim();
+        delete feature;
+    }
+
+    OnlineParallelFeature::~OnlineParallelFeature() { }
+
+    int32 OnlineParallelFeature::Dim() const {
+        return dim_;
+    }
+
+    BaseFloat OnlineParallelFeature::FrameShiftInSeconds() const {
+        return frame_opts_.frame_shift_ms * 1.0e-03;
+    }
+
+    int32 OnlineParallelFeature::NumFramesReady() const {
+        return frames_.NumRows();
+    }
+
+    bool OnlineParallelFeature::IsLastFrame(int32 frame) const {
+        return input_finished_ && frame == frames_.NumRows() - 1;
+    }
+
+    void OnlineParallelFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+        KALDI_ASSERT(frame >= 0 && frame < frames_.NumRows());
+        feat->CopyFromVec(frames_.Row(frame));
+    }
+
+    void OnlineParallelFeature::AcceptWaveform(BaseFloat sampling_rate,
+                                               const VectorBase<BaseFloat> &waveform) {
+        KALDI_ASSERT(!input_finished_);
+        if(sampling_rate_ != 0.0 && sampling_rate != sampling_rate_) {
+            KALDI_ERR << "Sampling frequency changed from " << sampling_rate_ << " to " << sampling_rate;
+        }
+        sampling_rate_ = sampling_rate;
+        waveform_.insert(waveform_.end(), waveform.Data(), waveform.Data() + waveform.Dim());
+    }
+
+    void OnlineParallelFeature::InputFinished() {
+        if(input_finished_) {
+            return;
+        }
+        input_finished_ = true;
+
+        int64 num_samples = waveform_.size();
+        int32 window_size = frame_opts_.WindowSize(),
+              window_shift = frame_opts_.WindowShift();
+        int32 num_frames = 0;
+        if(num_samples >= window_size) {
+            num_frames = 1 + static_cast<int32>((num_samples - window_size) / window_shift);
+        }
+        frames_.Resize(num_frames, dim_);
+        if(num_frames == 0) {
+            return;
+        }
+
+        int32 num_jobs = std::min(num_threads_, num_frames);
+        int32 job_frames = (num_frames + num_jobs - 1) / num_jobs;
+        std::vector<Job> jobs;
+        for(int32 begin = 0; begin < num_frames; begin += job_frames) {
+            Job job;
+            job.self = this;
+            job.begin_frame = begin;
+            job.end_frame = std::min(begin + job_frames, num_frames);
+            jobs.push_back(job);
+        }
+
+        // The first range is computed on the calling thread.
+        std::vector<pthread_t> threads(jobs.size());
+        std::vector<bool> started(jobs.size(), false);
+        for(size_t i = 1; i < jobs.size(); i++) {
+            started[i] = pthread_create(&threads[i], NULL, &OnlineParallelFeature::RunJob, &jobs[i]) == 0;
+            if(!started[i]) {
+                KALDI_WARN << "Could not start feature extraction thread; computing on this one.";
+                RunJob(&jobs[i]);
+            }
+        }
+        RunJob(&jobs[0]);
+        for(size_t i = 1; i < jobs.size(); i++) {
+            if(started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+
+        waveform_.clear();
+        for(size_t i = 0; i < jobs.size(); i++) {
+            if(jobs[i].error != "") {
+                KALDI_ERR << "Feature extraction failed: " << jobs[i].error;
+            }
+        }
+    }
+
+    void *OnlineParallelFeature::RunJob(void *arg) {
+        Job *job = static_cast<Job *>(arg);
+        try {
+            job->self->ComputeFrames(job->begin_frame, job->end_frame);
+        } catch(const std::exception &e) {
+            job->error = e.what();
+        }
+        return NULL;
+    }
+
+    void OnlineParallelFeature::ComputeFrames(int32 begin_frame, int32 end_frame) {
+        // Exactly the samples of the windows of the frames; the last range
+        // gets the remaining samples as well, which yield no more frames.
+        int32 window_size = frame_opts_.WindowSize(),
+              window_shift = frame_opts_.WindowShift();
+        int64 begin_sample = static_cast<int64>(begin_frame) * window_shift,
+              end_sample = static_cast<int64>(end_frame - 1) * window_shift + window_size;
+        if(end_frame == frames_.NumRows()) {
+            end_sample = waveform_.size();
+        }
+        SubVector<BaseFloat> waveform(&waveform_[begin_sample], end_sample - begin_sample);
+
+        OnlineBaseFeature *feature = NewFeature();
+        try {
+            feature->AcceptWaveform(sampling_rate_, waveform);
+            feature->InputFinished();
+            KALDI_ASSERT(feature->NumFramesReady() == end_frame - begin_frame);
+            for(int32 frame = begin_frame; frame < end_frame; frame++) {
+                SubVector<BaseFloat> row(frames_, frame);
+                feature->GetFrame(frame - begin_frame, &row);
+            }
+        } catch(...) {
+            delete feature;
+            throw;
+        }
+        delete feature;
+    }
+
+    OnlineBaseFeature *OnlineParallelFeature::NewFeature() const {
+        if(config_.feature_type == DecoderConfig::MFCC) {
+            if(config_.fast_base_feature) {
+                return new OnlineFastFeature(config_.mfcc_opts);
+            }
+            return new OnlineMfcc(config_.mfcc_opts);
+        } else if(config_.feature_type == DecoderConfig::FBANK) {
+            if(config_.fast_base_feature) {
+                return new OnlineFastFeature(config_.fbank_opts);
+            }
+            return new OnlineFbank(config_.fbank_opts);
+        } else {
+            KALDI_ERR << "You have to specify a valid feature_type.";
+            return NULL;
+        }
+    }
+}
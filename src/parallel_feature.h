@@ -0,0 +1,59 @@
+#ifndef ALEX_ASR_PARALLEL_FEATURE_H_
+#define ALEX_ASR_PARALLEL_FEATURE_H_
+
+#include <vector>
+
+#include "feat/online-feature.h"
+#include "src/decoder_config.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // MFCC/FBANK feature for audio that is available as a whole. The audio
+    // is only buffered until InputFinished; then the frames are split into
+    // num_threads ranges, each computed on its own thread from the samples
+    // of its frame windows, and no frame is ready before that. Each frame
+    // depends only on the samples of its window (with --snip-edges=true), so
+    // the frames are the same as those of the sequential feature, except for
+    // the dithering noise.
+    class OnlineParallelFeature : public OnlineBaseFeature {
+    public:
+        OnlineParallelFeature(const DecoderConfig &config, int32 num_threads);
+        virtual ~OnlineParallelFeature();
+
+        virtual int32 Dim() const;
+        virtual int32 NumFramesReady() const;
+        virtual bool IsLastFrame(int32 frame) const;
+        virtual BaseFloat FrameShiftInSeconds() const;
+        virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+
+        virtual void AcceptWaveform(BaseFloat sampling_rate,
+                                    const VectorBase<BaseFloat> &waveform);
+        virtual void InputFinished();
+    private:
+        struct Job {
+            OnlineParallelFeature *self;
+            int32 begin_frame;
+            int32 end_frame;
+            std::string error;
+        };
+
+        static void *RunJob(void *job);
+        void ComputeFrames(int32 begin_frame, int32 end_frame);
+        OnlineBaseFeature *NewFeature() const;
+
+        const DecoderConfig &config_;
+        const FrameExtractionOptions &frame_opts_;
+        int32 num_threads_;
+        int32 dim_;
+        BaseFloat sampling_rate_;
+
+        std::vector<BaseFloat> waveform_;
+        bool input_finished_;
+        Matrix<BaseFloat> frames_;
+
+        KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineParallelFeature);
+    };
+}
+
+#endif  // ALEX_ASR_PARALLEL_FEATURE_H_
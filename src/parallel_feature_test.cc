@@ -0,0 +1,121 @@
+#include "src/parallel_feature.h"
+
+#include "feat/wave-reader.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+using namespace alex_asr;
+
+namespace {
+    // Computes the features of the waveform sequentially and on num_threads
+    // threads and checks that the frames are the same.
+    void CompareFeatures(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq,
+                         const DecoderConfig &config, OnlineBaseFeature *expected, int32 num_threads) {
+        OnlineParallelFeature actual(config, num_threads);
+        expected->AcceptWaveform(samp_freq, waveform);
+        expected->InputFinished();
+        actual.AcceptWaveform(samp_freq, waveform);
+        KALDI_ASSERT(actual.NumFramesReady() == 0);
+        actual.InputFinished();
+
+        int32 num_frames = expected->NumFramesReady();
+        KALDI_ASSERT(num_frames > 0 && actual.NumFramesReady() == num_frames);
+        KALDI_ASSERT(actual.Dim() == expected->Dim());
+        KALDI_ASSERT(actual.IsLastFrame(num_frames - 1) && !actual.IsLastFrame(num_frames - 2));
+
+        Vector<BaseFloat> expected_frame(expected->Dim()), actual_frame(actual.Dim());
+        for(int32 frame = 0; frame < num_frames; frame++) {
+            expected->GetFrame(frame, &expected_frame);
+            actual.GetFrame(frame, &actual_frame);
+            for(int32 i = 0; i < expected_frame.Dim(); i++) {
+                if(actual_frame(i) != expected_frame(i)) {
+                    KALDI_ERR << "Frame " << frame << " with " << num_threads << " threads differs: expected "
+                              << expected_frame << "got " << actual_frame;
+                }
+            }
+        }
+    }
+
+    // Whole file on a few thread counts, and a few frames on more threads
+    // than frames.
+    void TestFeature(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, const DecoderConfig &config) {
+        const FrameExtractionOptions &frame_opts = config.feature_type == DecoderConfig::MFCC ?
+                                                   config.mfcc_opts.frame_opts : config.fbank_opts.frame_opts;
+        SubVector<BaseFloat> short_waveform(waveform, 0, frame_opts.WindowSize() + 2 * frame_opts.WindowShift());
+        int32 thread_counts[] = { 1, 2, 3, 8 };
+        for(size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+            for(int32 part = 0; part < 2; part++) {
+                const VectorBase<BaseFloat> *input = part == 0 ? &waveform : &short_waveform;
+                OnlineBaseFeature *expected;
+                if(config.feature_type == DecoderConfig::MFCC) {
+                    expected = new OnlineMfcc(config.mfcc_opts);
+                } else {
+                    expected = new OnlineFbank(config.fbank_opts);
+                }
+                try {
+                    CompareFeatures(*input, samp_freq, config, expected, thread_counts[i]);
+                } catch(...) {
+                    delete expected;
+                    throw;
+                }
+                delete expected;
+            }
+        }
+    }
+
+    void TestMfcc(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, bool use_energy) {
+        DecoderConfig config;
+        config.feature_type = DecoderConfig::MFCC;
+        config.mfcc_opts.frame_opts.dither = 0.0;
+        config.mfcc_opts.frame_opts.samp_freq = samp_freq;
+        config.mfcc_opts.use_energy = use_energy;
+        TestFeature(waveform, samp_freq, config);
+        KALDI_LOG << "MFCC with use_energy=" << use_energy << " matches.";
+    }
+
+    void TestFbank(const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq, bool use_energy) {
+        DecoderConfig config;
+        config.feature_type = DecoderConfig::FBANK;
+        config.fbank_opts.frame_opts.dither = 0.0;
+        config.fbank_opts.frame_opts.samp_freq = samp_freq;
+        config.fbank_opts.use_energy = use_energy;
+        TestFeature(waveform, samp_freq, config);
+        KALDI_LOG << "FBANK with use_energy=" << use_energy << " matches.";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Checks that OnlineParallelFeature computes the frames of OnlineMfcc and OnlineFbank.\n"
+                "\n"
+                "Usage:  parallel_feature_test [<wav-file>]\n";
+
+        ParseOptions po(usage);
+        po.Read(argc, argv);
+        if(po.NumArgs() > 1) {
+            po.PrintUsage();
+            exit(1);
+        }
+        std::string wav_rxfilename = po.NumArgs() == 1 ? po.GetArg(1) : "test/eleven.wav";
+
+        WaveData wave_data;
+        {
+            bool binary;
+            Input ki(wav_rxfilename, &binary);
+            wave_data.Read(ki.Stream());
+        }
+        SubVector<BaseFloat> waveform(wave_data.Data(), 0);
+
+        TestMfcc(waveform, wave_data.SampFreq(), true);
+        TestMfcc(waveform, wave_data.SampFreq(), false);
+        TestFbank(waveform, wave_data.SampFreq(), true);
+        TestFbank(waveform, wave_data.SampFreq(), false);
+
+        KALDI_LOG << "Test OK.";
+        return 0;
+    } catch(const std::exception &e) {
+        std::cerr << e.what();
+        return -1;
+    }
+}
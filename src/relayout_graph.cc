@@ -0,0 +1,41 @@
+#include "src/decoding_graph.h"
+#include "util/common-utils.h"
+
+using namespace kaldi;
+using namespace alex_asr;
+
+int main(int argc, char *argv[]) {
+    try {
+        const char *usage =
+                "Re-layout a decoding graph for faster search: states are renumbered in the\n"
+                "breadth-first order from the start state and the graph is stored as a ConstFst.\n"
+                "\n"
+                "Usage:  relayout_graph [options] <graph-in> <graph-out>\n"
+                " e.g.:  relayout_graph HCLG.fst HCLG.const.fst\n";
+
+        ParseOptions po(usage);
+        po.Read(argc, argv);
+
+        if(po.NumArgs() != 2) {
+            po.PrintUsage();
+            exit(1);
+        }
+
+        std::string graph_rxfilename = po.GetArg(1),
+                graph_wxfilename = po.GetArg(2);
+
+        fst::StdFst *graph = ReadGraph(graph_rxfilename);
+        fst::StdConstFst *relayout_graph = RelayoutGraph(*graph);
+        delete graph;
+
+        WriteGraph(*relayout_graph, graph_wxfilename);
+        KALDI_LOG << "Wrote graph with " << relayout_graph->NumStates() << " states to "
+                  << graph_wxfilename;
+        delete relayout_graph;
+
+        return 0;
+    } catch(const std::exception &e) {
+        std::cerr << e.what();
+        return -1;
+    }
+}
@@ -0,0 +1,103 @@
+#include "src/session_log.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    static void WriteString(std::ostream &os, bool binary, const std::string &str) {
+        WriteBasicType(os, binary, static_cast<int32>(str.size()));
+        os.write(str.data(), str.size());
+    }
+
+    static void ReadString(std::istream &is, bool binary, std::string *str) {
+        int32 size;
+        ReadBasicType(is, binary, &size);
+        KALDI_ASSERT(size >= 0);
+        str->resize(size);
+        if(size > 0) {
+            is.read(&(*str)[0], size);
+        }
+        if(is.fail()) {
+            KALDI_ERR << "Truncated session log.";
+        }
+    }
+
+    SessionLog::SessionLog() { }
+
+    void SessionLog::Clear(const std::string &adaptation_state) {
+        adaptation_state_ = adaptation_state;
+        events_.clear();
+        waveform_.clear();
+    }
+
+    void SessionLog::AddAudio(const VectorBase<BaseFloat> &waveform) {
+        waveform_.insert(waveform_.end(), waveform.Data(), waveform.Data() + waveform.Dim());
+        AddEvent(kAudio, waveform.Dim());
+    }
+
+    void SessionLog::AddEvent(EventType type, int32 value) {
+        events_.push_back(std::make_pair(static_cast<int32>(type), value));
+    }
+
+    void SessionLog::GetAudio(int32 offset, int32 n, Vector<BaseFloat> *waveform) const {
+        KALDI_ASSERT(offset >= 0 && offset + n <= static_cast<int32>(waveform_.size()));
+        waveform->Resize(n, kUndefined);
+        if(n > 0) {
+            waveform->CopyFromVec(SubVector<BaseFloat>(const_cast<BaseFloat*>(&waveform_[offset]), n));
+        }
+    }
+
+    void SessionLog::Write(std::ostream &os, bool binary) const {
+        WriteToken(os, binary, "<SessionLog>");
+        WriteString(os, binary, adaptation_state_);
+        WriteIntegerPairVector(os, binary, events_);
+
+        // Audio fed through FrameIn(buffer) holds integer samples; store it as
+        // 16 bit PCM when that is lossless, which halves the size of the log.
+        bool is_pcm16 = true;
+        for(size_t i = 0; i < waveform_.size() && is_pcm16; i++) {
+            BaseFloat sample = waveform_[i];
+            is_pcm16 = sample >= -32768.0 && sample <= 32767.0 && sample == std::floor(sample);
+        }
+        WriteToken(os, binary, is_pcm16 ? "<Pcm16>" : "<Float>");
+        WriteBasicType(os, binary, static_cast<int32>(waveform_.size()));
+        if(is_pcm16) {
+            std::vector<int16> pcm(waveform_.begin(), waveform_.end());
+            if(!pcm.empty()) {
+                os.write(reinterpret_cast<const char*>(&pcm[0]), pcm.size() * sizeof(int16));
+            }
+        } else if(!waveform_.empty()) {
+            os.write(reinterpret_cast<const char*>(&waveform_[0]), waveform_.size() * sizeof(BaseFloat));
+        }
+        WriteToken(os, binary, "</SessionLog>");
+    }
+
+    void SessionLog::Read(std::istream &is, bool binary) {
+        ExpectToken(is, binary, "<SessionLog>");
+        ReadString(is, binary, &adaptation_state_);
+        ReadIntegerPairVector(is, binary, &events_);
+
+        std::string token;
+        int32 size;
+        ReadToken(is, binary, &token);
+        ReadBasicType(is, binary, &size);
+        KALDI_ASSERT(size >= 0);
+        waveform_.resize(size);
+        if(token == "<Pcm16>") {
+            std::vector<int16> pcm(size);
+            if(size > 0) {
+                is.read(reinterpret_cast<char*>(&pcm[0]), size * sizeof(int16));
+            }
+            std::copy(pcm.begin(), pcm.end(), waveform_.begin());
+        } else if(token == "<Float>") {
+            if(size > 0) {
+                is.read(reinterpret_cast<char*>(&waveform_[0]), size * sizeof(BaseFloat));
+            }
+        } else {
+            KALDI_ERR << "Unexpected token " << token << " in session log.";
+        }
+        if(is.fail()) {
+            KALDI_ERR << "Truncated session log.";
+        }
+        ExpectToken(is, binary, "</SessionLog>");
+    }
+}
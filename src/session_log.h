@@ -0,0 +1,43 @@
+#ifndef ALEX_ASR_SESSION_LOG_H_
+#define ALEX_ASR_SESSION_LOG_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Record of everything that happened to a decoder since the start of the
+    // current utterance: the adaptation state it started from, the input audio
+    // and the sequence of calls that fed and advanced the decoding. Feature
+    // extraction and search are deterministic, so replaying the record on a
+    // decoder with the same model reproduces the session exactly.
+    class SessionLog {
+    public:
+        enum EventType { kAudio = 0, kDecode = 1, kInputFinished = 2, kFinalize = 3 };
+
+        SessionLog();
+
+        void Clear(const std::string &adaptation_state);
+        void AddAudio(const VectorBase<BaseFloat> &waveform);
+        void AddEvent(EventType type, int32 value);
+
+        void Write(std::ostream &os, bool binary) const;
+        void Read(std::istream &is, bool binary);
+
+        const std::string &AdaptationState() const { return adaptation_state_; }
+        const std::vector<std::pair<int32, int32> > &Events() const { return events_; }
+        // Copies n samples of the recorded audio starting at offset into waveform.
+        void GetAudio(int32 offset, int32 n, Vector<BaseFloat> *waveform) const;
+    private:
+        std::string adaptation_state_;
+        std::vector<std::pair<int32, int32> > events_;
+        std::vector<BaseFloat> waveform_;
+    };
+}
+
+#endif  // ALEX_ASR_SESSION_LOG_H_
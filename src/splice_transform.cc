@@ -0,0 +1,120 @@
+#include "src/splice_transform.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    OnlineSpliceTransform::OnlineSpliceTransform(const OnlineSpliceOptions &opts,
+                                                 const MatrixBase<BaseFloat> &transform,
+                                                 OnlineFeatureInterface *src,
+                                                 int32 block_size) :
+            left_context_(opts.left_context),
+            right_context_(opts.right_context),
+            block_size_(block_size),
+            src_(src),
+            transform_(transform),
+            block_begin_(0)
+    {
+        KALDI_ASSERT(block_size_ > 0);
+        if(transform_.NumCols() != (left_context_ + right_context_ + 1) * src_->Dim() + 1) {
+            KALDI_ERR << "Dimension mismatch: fused transform has " << transform_.NumCols()
+                      << " columns, spliced feature has dimension "
+                      << (left_context_ + right_context_ + 1) * src_->Dim();
+        }
+    }
+
+    int32 OnlineSpliceTransform::Dim() const {
+        return transform_.NumRows();
+    }
+
+    int32 OnlineSpliceTransform::NumFramesReady() const {
+        int32 num_frames = src_->NumFramesReady();
+        if(num_frames > 0 && src_->IsLastFrame(num_frames - 1)) {
+            return num_frames;
+        } else {
+            return std::max<int32>(0, num_frames - right_context_);
+        }
+    }
+
+    bool OnlineSpliceTransform::IsLastFrame(int32 frame) const {
+        return src_->IsLastFrame(frame);
+    }
+
+    BaseFloat OnlineSpliceTransform::FrameShiftInSeconds() const {
+        return src_->FrameShiftInSeconds();
+    }
+
+    void OnlineSpliceTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+        KALDI_ASSERT(frame >= 0 && frame < NumFramesReady());
+
+        if(frame < block_begin_ || frame >= block_begin_ + block_.NumRows()) {
+            ComputeBlock(frame);
+        }
+        feat->CopyFromVec(block_.Row(frame - block_begin_));
+    }
+
+    void OnlineSpliceTransform::ComputeBlock(int32 begin_frame) {
+        int32 end_frame = std::min(begin_frame + block_size_, NumFramesReady()),
+              num_frames = end_frame - begin_frame,
+              src_ready = src_->NumFramesReady(),
+              src_dim = src_->Dim(),
+              context = left_context_ + right_context_ + 1;
+
+        // Fetch every source frame the block depends on exactly once.
+        int32 src_begin = std::max(0, begin_frame - left_context_),
+              src_end = std::min(src_ready, end_frame + right_context_);
+        Matrix<BaseFloat> src_feats(src_end - src_begin, src_dim, kUndefined);
+        for(int32 t = src_begin; t < src_end; t++) {
+            SubVector<BaseFloat> row(src_feats, t - src_begin);
+            src_->GetFrame(t, &row);
+        }
+
+        // Spliced frames with a trailing 1.0 for the offset of the transform.
+        Matrix<BaseFloat> spliced(num_frames, context * src_dim + 1, kUndefined);
+        for(int32 i = 0; i < num_frames; i++) {
+            for(int32 j = -left_context_; j <= right_context_; j++) {
+                int32 src_frame = std::min(std::max(begin_frame + i + j, 0), src_ready - 1);
+                SubVector<BaseFloat> dst(spliced.Row(i), (j + left_context_) * src_dim, src_dim);
+                dst.CopyFromVec(src_feats.Row(src_frame - src_begin));
+            }
+            spliced(i, context * src_dim) = 1.0;
+        }
+
+        block_.Resize(num_frames, transform_.NumRows(), kUndefined);
+        block_.AddMatMat(1.0, spliced, kNoTrans, transform_, kTrans, 0.0);
+        block_begin_ = begin_frame;
+    }
+
+    void ToAffineTransform(const MatrixBase<BaseFloat> &transform,
+                           int32 input_dim,
+                           Matrix<BaseFloat> *affine) {
+        if(transform.NumCols() == input_dim) {
+            affine->Resize(transform.NumRows(), input_dim + 1);
+            affine->Range(0, transform.NumRows(), 0, input_dim).CopyFromMat(transform);
+        } else if(transform.NumCols() == input_dim + 1) {
+            affine->Resize(transform.NumRows(), input_dim + 1, kUndefined);
+            affine->CopyFromMat(transform);
+        } else {
+            KALDI_ERR << "Dimension mismatch: transform has " << transform.NumCols()
+                      << " columns, input has dimension " << input_dim;
+        }
+    }
+
+    void ComposeAffineTransforms(const MatrixBase<BaseFloat> &first,
+                                 const MatrixBase<BaseFloat> &second,
+                                 int32 input_dim,
+                                 Matrix<BaseFloat> *composed) {
+        Matrix<BaseFloat> first_affine, second_affine;
+        ToAffineTransform(first, input_dim, &first_affine);
+
+        int32 mid_dim = first_affine.NumRows();
+        ToAffineTransform(second, mid_dim, &second_affine);
+
+        // second(first(x)) = S_lin * (F x + f) + s
+        composed->Resize(second_affine.NumRows(), input_dim + 1);
+        composed->AddMatMat(1.0, second_affine.Range(0, second_affine.NumRows(), 0, mid_dim), kNoTrans,
+                            first_affine, kNoTrans, 0.0);
+        for(int32 i = 0; i < composed->NumRows(); i++) {
+            (*composed)(i, input_dim) += second_affine(i, mid_dim);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef ALEX_ASR_SPLICE_TRANSFORM_H_
+#define ALEX_ASR_SPLICE_TRANSFORM_H_
+
+#include "feat/online-feature.h"
+#include "matrix/matrix-lib.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Fused replacement for OnlineSpliceFrames followed by one or more
+    // OnlineTransform stages. The transforms are precomputed into a single
+    // affine matrix, and frames are spliced and transformed a block at a time
+    // with one matrix multiplication instead of per-frame matrix-vector
+    // products.
+    class OnlineSpliceTransform : public OnlineFeatureInterface {
+    public:
+        // "transform" is an affine transform of the spliced features, i.e. it
+        // has (left_context + right_context + 1) * src->Dim() + 1 columns.
+        OnlineSpliceTransform(const OnlineSpliceOptions &opts,
+                              const MatrixBase<BaseFloat> &transform,
+                              OnlineFeatureInterface *src,
+                              int32 block_size);
+
+        virtual int32 Dim() const;
+        virtual int32 NumFramesReady() const;
+        virtual bool IsLastFrame(int32 frame) const;
+        virtual BaseFloat FrameShiftInSeconds() const;
+        virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+    private:
+        void ComputeBlock(int32 begin_frame);
+
+        int32 left_context_;
+        int32 right_context_;
+        int32 block_size_;
+        OnlineFeatureInterface *src_;
+        Matrix<BaseFloat> transform_;
+
+        int32 block_begin_;
+        Matrix<BaseFloat> block_;
+    };
+
+    // Composes affine transforms applied in order (first, then second) into
+    // one affine transform of a feature with dimension input_dim. Each of the
+    // transforms may be either linear or affine (extra offset column).
+    void ComposeAffineTransforms(const MatrixBase<BaseFloat> &first,
+                                 const MatrixBase<BaseFloat> &second,
+                                 int32 input_dim,
+                                 Matrix<BaseFloat> *composed);
+
+    void ToAffineTransform(const MatrixBase<BaseFloat> &transform,
+                           int32 input_dim,
+                           Matrix<BaseFloat> *affine);
+}
+
+#endif  // ALEX_ASR_SPLICE_TRANSFORM_H_
@@ -0,0 +1,148 @@
+#include "src/stream_protocol.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace kaldi;
+
+namespace alex_asr {
+    namespace {
+        // Returns the number of bytes read; less than length only at the end
+        // of the stream.
+        size_t ReadFully(int fd, char *data, size_t length) {
+            size_t done = 0;
+            while(done < length) {
+                ssize_t n = read(fd, data + done, length - done);
+                if(n < 0) {
+                    if(errno == EINTR) continue;
+                    KALDI_ERR << "Error reading from the stream: " << strerror(errno);
+                }
+                if(n == 0) break;
+                done += n;
+            }
+            return done;
+        }
+
+        void WriteFully(int fd, const char *data, size_t length) {
+            size_t done = 0;
+            while(done < length) {
+                // No SIGPIPE when the other side is gone; the error is reported instead.
+                ssize_t n = send(fd, data + done, length - done, MSG_NOSIGNAL);
+                if(n < 0) {
+                    if(errno == EINTR) continue;
+                    KALDI_ERR << "Error writing to the stream: " << strerror(errno);
+                }
+                done += n;
+            }
+        }
+
+        // Fills the socket address for address; returns its length.
+        socklen_t ParseAddress(const std::string &address, sockaddr_storage *addr) {
+            memset(addr, 0, sizeof(*addr));
+            if(address.compare(0, 5, "unix:") == 0) {
+                std::string path = address.substr(5);
+                sockaddr_un *un = reinterpret_cast<sockaddr_un *>(addr);
+                if(path.empty() || path.size() >= sizeof(un->sun_path)) {
+                    KALDI_ERR << "Invalid Unix socket path: " << path;
+                }
+                un->sun_family = AF_UNIX;
+                strncpy(un->sun_path, path.c_str(), sizeof(un->sun_path) - 1);
+                return sizeof(sockaddr_un);
+            } else if(address.compare(0, 4, "tcp:") == 0) {
+                int32 port;
+                if(!ConvertStringToInteger(address.substr(4), &port) || port <= 0 || port > 65535) {
+                    KALDI_ERR << "Invalid TCP port: " << address.substr(4);
+                }
+                sockaddr_in *in = reinterpret_cast<sockaddr_in *>(addr);
+                in->sin_family = AF_INET;
+                in->sin_port = htons(port);
+                in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                return sizeof(sockaddr_in);
+            } else {
+                KALDI_ERR << "Invalid address " << address << "; expected unix:<path> or tcp:<port>.";
+                return 0;
+            }
+        }
+    }
+
+    bool ReadStreamMessage(int fd, char *type, std::string *payload) {
+        char header[5];
+        size_t n = ReadFully(fd, header, sizeof(header));
+        if(n == 0) {
+            return false;
+        } else if(n < sizeof(header)) {
+            KALDI_ERR << "The stream ended inside a message header.";
+        }
+
+        uint32 length;
+        memcpy(&length, header + 1, sizeof(length));
+        length = ntohl(length);
+        if(length > kMaxStreamPayload) {
+            KALDI_ERR << "Message of " << length << " bytes exceeds the limit of "
+                      << kMaxStreamPayload << " bytes.";
+        }
+
+        *type = header[0];
+        payload->resize(length);
+        if(length > 0 && ReadFully(fd, &(*payload)[0], length) < length) {
+            KALDI_ERR << "The stream ended inside a message.";
+        }
+        return true;
+    }
+
+    void WriteStreamMessage(int fd, char type, const std::string &payload) {
+        KALDI_ASSERT(payload.size() <= kMaxStreamPayload);
+
+        char header[5];
+        header[0] = type;
+        uint32 length = htonl(static_cast<uint32>(payload.size()));
+        memcpy(header + 1, &length, sizeof(length));
+
+        WriteFully(fd, header, sizeof(header));
+        WriteFully(fd, payload.data(), payload.size());
+    }
+
+    int ListenStream(const std::string &address, int backlog) {
+        sockaddr_storage addr;
+        socklen_t addr_len = ParseAddress(address, &addr);
+
+        int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+        if(fd < 0) {
+            KALDI_ERR << "Could not create socket: " << strerror(errno);
+        }
+        if(addr.ss_family == AF_UNIX) {
+            // A socket file left behind by a previous server.
+            unlink(reinterpret_cast<sockaddr_un *>(&addr)->sun_path);
+        } else {
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+        if(bind(fd, reinterpret_cast<sockaddr *>(&addr), addr_len) != 0 || listen(fd, backlog) != 0) {
+            int error = errno;
+            close(fd);
+            KALDI_ERR << "Could not listen on " << address << ": " << strerror(error);
+        }
+        return fd;
+    }
+
+    int ConnectStream(const std::string &address) {
+        sockaddr_storage addr;
+        socklen_t addr_len = ParseAddress(address, &addr);
+
+        int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+        if(fd < 0) {
+            KALDI_ERR << "Could not create socket: " << strerror(errno);
+        }
+        if(connect(fd, reinterpret_cast<sockaddr *>(&addr), addr_len) != 0) {
+            int error = errno;
+            close(fd);
+            KALDI_ERR << "Could not connect to " << address << ": " << strerror(error);
+        }
+        return fd;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef ALEX_ASR_STREAM_PROTOCOL_H_
+#define ALEX_ASR_STREAM_PROTOCOL_H_
+
+#include <string>
+
+#include "base/kaldi-common.h"
+
+using namespace kaldi;
+
+namespace alex_asr {
+    // Protocol of decode_server. Every message is framed as one type byte, the
+    // payload length as a 4-byte unsigned integer in network byte order, and
+    // the payload. A stream may carry any number of utterances.
+    enum StreamMessageType {
+        // Client to server.
+        kStreamAudio = 'A',           // 16-bit little-endian PCM samples.
+        kStreamSamplingRate = 'R',    // Input sampling frequency in Hz as decimal text;
+                                      // only between utterances.
+        kStreamEndOfUtterance = 'E',  // Finalize the current utterance.
+        // Server to client; hypotheses are words separated by spaces.
+        kStreamPartial = 'P',         // The current hypothesis changed.
+        kStreamStable = 'S',          // Prefix of the hypothesis that will not change.
+        kStreamEndpoint = 'N',        // Endpoint detected in the current utterance.
+        kStreamCommit = 'C',          // Words committed in the long-audio mode or of a
+                                      // segment finalized with --auto_segment; later
+                                      // messages of the utterance start after them.
+        kStreamFinal = 'F',           // Final hypothesis; answers kStreamEndOfUtterance.
+        kStreamError = 'X'            // Error message; the server closes the stream.
+    };
+
+    // Upper bound of the payload length; longer messages are a protocol error.
+    const uint32 kMaxStreamPayload = 1 << 24;
+
+    // Reads one message. Returns false if the stream ended cleanly before it;
+    // throws on errors and on streams ending inside a message.
+    bool ReadStreamMessage(int fd, char *type, std::string *payload);
+    void WriteStreamMessage(int fd, char type, const std::string &payload);
+
+    // Addresses are "unix:<path>" for a Unix domain socket or "tcp:<port>"
+    // for a TCP socket on the loopback interface.
+    int ListenStream(const std::string &address, int backlog);
+    int ConnectStream(const std::string &address);
+}
+
+#endif  // ALEX_ASR_STREAM_PROTOCOL_H_
@@ -13,6 +13,7 @@
 // MERCHANTABLITY OR NON-INFRINGEMENT.
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
+#include <limits>
 #include <string>
 #include "lat/kaldi-lattice.h"
 #include "fstext/fstext-utils.h"
@@ -25,10 +26,6 @@ using namespace kaldi;
 
 namespace alex_asr {
 
-// instantiate the template used below here
-// TODO
-// template double ComputeLatticeAlphasAndBetas<CompactLattice>;
-
   void MovePostToArcs(const std::vector<double> &alpha,
                       const std::vector<double> &beta,
                       fst::VectorFst<fst::LogArc> * lat) {
@@ -43,13 +40,7 @@ namespace alex_asr {
         StateId j = arc.nextstate;
         // w(i,j) = alpha(i) * w(i,j) * beta(j) / (alpha(i) * beta(i))
         // w(i,j) = w(i,j) * beta(j) / beta(i)
-        double orig_w = ConvertToCost(arc.weight);
-        double numer = orig_w + -beta[j];
-        KALDI_VLOG(3) << "arc(" << i << ',' << j << ')' << std::endl <<
-          "orig_w:" << orig_w << " beta[j=" << j << "]:" << -beta[j] <<
-          " beta[i=" << i << "]:" << -beta[i] << " numer:" << numer << std::endl;
-        double new_w = numer - (-beta[i]);
-        KALDI_VLOG(3) << "arc orig: " << orig_w << " new: " << new_w << std::endl;
+        double new_w = ConvertToCost(arc.weight) - beta[j] + beta[i];
         arc.weight = LogWeight(new_w);
 
         aiter.SetValue(arc);
@@ -57,18 +48,158 @@ namespace alex_asr {
     }
   }
 
-  double CompactLatticeToWordsPost(CompactLattice &clat, fst::VectorFst<fst::LogArc> *pst) {
+  namespace {
+    // log(sum(exp(v[i]))) with a single log per call instead of one
+    // LogAdd (exp + log1p + branches) per element.
+    inline double LogSumExp(const double *v, int32 n) {
+      if (n == 0) return kLogZeroDouble;
+      double max = v[0];
+      for (int32 i = 1; i < n; i++)
+        max = std::max(max, v[i]);
+      if (max == kLogZeroDouble) return kLogZeroDouble;
+      double sum = 0.0;
+      for (int32 i = 0; i < n; i++)
+        sum += exp(v[i] - max);
+      return max + log(sum);
+    }
+
+    // Forward-backward over a topologically sorted acceptor, on flat arrays
+    // of incoming and outgoing arcs rather than through arc iterators.
+    double ComputeLatticeAlphasAndBetas(const fst::VectorFst<fst::LogArc> &lat,
+                                        std::vector<double> *alpha,
+                                        std::vector<double> *beta) {
+      using namespace fst;
+      typedef LogArc::StateId StateId;
+
+      StateId num_states = lat.NumStates();
+      KALDI_ASSERT(lat.Properties(fst::kTopSorted, true) == fst::kTopSorted);
+      KALDI_ASSERT(lat.Start() == 0);
+
+      std::vector<int32> out_offsets(num_states + 1, 0), out_next,
+          in_offsets(num_states + 1, 0), in_prev;
+      std::vector<double> out_like, in_like, final_like(num_states);
+      for (StateId s = 0; s < num_states; s++) {
+        for (ArcIterator<VectorFst<LogArc> > aiter(lat, s); !aiter.Done(); aiter.Next()) {
+          const LogArc &arc = aiter.Value();
+          out_next.push_back(arc.nextstate);
+          out_like.push_back(-ConvertToCost(arc.weight));
+          in_offsets[arc.nextstate + 1]++;
+        }
+        out_offsets[s + 1] = out_next.size();
+        final_like[s] = -ConvertToCost(lat.Final(s));
+      }
+      for (StateId s = 0; s < num_states; s++)
+        in_offsets[s + 1] += in_offsets[s];
+      in_prev.resize(out_next.size());
+      in_like.resize(out_next.size());
+      {
+        std::vector<int32> fill(in_offsets.begin(), in_offsets.end() - 1);
+        for (StateId s = 0; s < num_states; s++) {
+          for (int32 a = out_offsets[s]; a < out_offsets[s + 1]; a++) {
+            int32 pos = fill[out_next[a]]++;
+            in_prev[pos] = s;
+            in_like[pos] = out_like[a];
+          }
+        }
+      }
+
+      alpha->resize(num_states, kLogZeroDouble);
+      beta->resize(num_states, kLogZeroDouble);
+      std::vector<double> terms(1);
+
+      // Alphas are gathered from the incoming arcs of each state.
+      (*alpha)[0] = 0.0;
+      for (StateId s = 1; s < num_states; s++) {
+        int32 begin = in_offsets[s], n = in_offsets[s + 1] - begin;
+        terms.resize(n + 1);
+        for (int32 a = 0; a < n; a++)
+          terms[a] = (*alpha)[in_prev[begin + a]] + in_like[begin + a];
+        (*alpha)[s] = LogSumExp(&terms[0], n);
+      }
+      terms.resize(num_states + 1);
+      for (StateId s = 0; s < num_states; s++)
+        terms[s] = (*alpha)[s] + final_like[s];
+      double tot_forward_prob = LogSumExp(&terms[0], num_states);
+
+      for (StateId s = num_states - 1; s >= 0; s--) {
+        int32 begin = out_offsets[s], n = out_offsets[s + 1] - begin;
+        terms.resize(n + 1);
+        for (int32 a = 0; a < n; a++)
+          terms[a] = (*beta)[out_next[begin + a]] + out_like[begin + a];
+        terms[n] = final_like[s];
+        (*beta)[s] = LogSumExp(&terms[0], n + 1);
+      }
+
+      double tot_backward_prob = (*beta)[lat.Start()];
+      if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
+        KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
+        << ", while total backward probability = " << tot_backward_prob;
+      }
+      // Split the difference when returning... they should be the same.
+      return 0.5 * (tot_backward_prob + tot_forward_prob);
+    }
+
+    int32 NumArcs(const CompactLattice &clat) {
+      int32 num_arcs = 0;
+      for (CompactLatticeArc::StateId s = 0; s < clat.NumStates(); s++)
+        num_arcs += clat.NumArcs(s);
+      return num_arcs;
+    }
+  }
+
+  double CompactLatticeToWordsPost(const CompactLattice &clat, fst::VectorFst<fst::LogArc> *pst,
+                                   const WordsPostOptions &opts) {
+    using namespace fst;
+    typedef CompactLatticeArc::StateId StateId;
 
-    {
-      Lattice lat;
-      fst::VectorFst<fst::StdArc> t_std;
-      RemoveAlignmentsFromCompactLattice(&clat); // remove the alignments
-      ConvertLattice(clat, &lat); // convert to non-compact form.. no new states
-      ConvertLattice(lat, &t_std); // this adds up the (lm,acoustic) costs
-      fst::Cast(t_std, pst);  // reinterpret the inner implementations
+    // Drop unlikely arcs first, so that neither minimization nor the
+    // forward-backward pass pays for them.
+    CompactLattice pruned(clat);
+    BaseFloat beam = opts.beam;
+    if (beam > 0.0)
+      PruneLattice(beam, &pruned);
+    if (opts.max_arcs > 0) {
+      if (beam <= 0.0) beam = 16.0;
+      int32 num_arcs;
+      while ((num_arcs = NumArcs(pruned)) > opts.max_arcs && beam > 0.1) {
+        beam *= 0.5;
+        KALDI_VLOG(2) << "Posterior lattice has " << num_arcs << " arcs, pruning with beam " << beam;
+        PruneLattice(beam, &pruned);
+      }
+      // Even the tightest beam keeps ties and near-ties; the best path is
+      // the smallest lattice left.
+      if (num_arcs > opts.max_arcs) {
+        CompactLattice best_path;
+        CompactLatticeShortestPath(pruned, &best_path);
+        pruned = best_path;
+        num_arcs = NumArcs(pruned);
+        if (num_arcs > opts.max_arcs)
+          KALDI_WARN << "The best path alone has " << num_arcs << " arcs, more than --post_lattice_max_arcs="
+                     << opts.max_arcs;
+      }
     }
-    fst::Project(pst, fst::PROJECT_OUTPUT);
 
+    // Word acceptor with the total costs, built directly from the compact
+    // lattice (the alignments are simply not copied).
+    pst->DeleteStates();
+    StateId num_states = pruned.NumStates();
+    for (StateId s = 0; s < num_states; s++)
+      pst->AddState();
+    if (num_states > 0)
+      pst->SetStart(pruned.Start());
+    for (StateId s = 0; s < num_states; s++) {
+      pst->ReserveArcs(s, pruned.NumArcs(s));
+      for (ArcIterator<CompactLattice> aiter(pruned, s); !aiter.Done(); aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        const LatticeWeight &w = arc.weight.Weight();
+        pst->AddArc(s, LogArc(arc.olabel, arc.olabel, LogWeight(w.Value1() + w.Value2()), arc.nextstate));
+      }
+      CompactLatticeWeight final_weight = pruned.Final(s);
+      if (final_weight != CompactLatticeWeight::Zero()) {
+        const LatticeWeight &w = final_weight.Weight();
+        pst->SetFinal(s, LogWeight(w.Value1() + w.Value2()));
+      }
+    }
 
     fst::Minimize(pst);
 
@@ -77,63 +208,140 @@ namespace alex_asr {
     double tot_lik;
     std::vector<double> alpha, beta;
     fst::TopSort(pst);
-    // tot_lik = ComputeCompactLatticeAlphasAndBetas(*pst, &alpha, &beta); // TODO
     tot_lik = ComputeLatticeAlphasAndBetas(*pst, &alpha, &beta);
     MovePostToArcs(alpha, beta, pst);
 
     return tot_lik;
   }
 
-  template<typename LatticeType>
-  static double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
-                                             vector<double> *alpha,
-                                             vector<double> *beta) {
-    typedef typename LatticeType::Arc Arc;
-    typedef typename Arc::Weight Weight;
-    typedef typename Arc::StateId StateId;
+  namespace {
+    // Appends the header and the fields shared by all kinds of flat lattices.
+    class FlatLatticeWriter {
+     public:
+      explicit FlatLatticeWriter(std::vector<char> *buffer) : buffer_(buffer) {
+        buffer_->clear();
+      }
+
+      template<typename T>
+      void Append(T value) {
+        const char *bytes = reinterpret_cast<const char*>(&value);
+        buffer_->insert(buffer_->end(), bytes, bytes + sizeof(T));
+      }
+
+      template<typename T>
+      void Append(const std::vector<T> &values) {
+        if (values.empty()) return;
+        const char *bytes = reinterpret_cast<const char*>(&values[0]);
+        buffer_->insert(buffer_->end(), bytes, bytes + values.size() * sizeof(T));
+      }
+
+      void AppendHeader(int32 kind, int32 num_states, int32 num_arcs,
+                        int32 start, int32 num_alignment, float tot_lik) {
+        buffer_->insert(buffer_->end(), "ALAT", "ALAT" + 4);
+        Append<int32>(1);
+        Append<int32>(kind);
+        Append<int32>(num_states);
+        Append<int32>(num_arcs);
+        Append<int32>(start);
+        Append<int32>(num_alignment);
+        Append<float>(tot_lik);
+      }
+
+     private:
+      std::vector<char> *buffer_;
+    };
+  }
+
+  void WordsPostToFlatLattice(const fst::VectorFst<fst::LogArc> &lat, double tot_lik,
+                              std::vector<char> *buffer) {
+    using namespace fst;
+    typedef LogArc::StateId StateId;
 
     StateId num_states = lat.NumStates();
-    KALDI_ASSERT(lat.Properties(fst::kTopSorted, true) == fst::kTopSorted);
-    KALDI_ASSERT(lat.Start() == 0);
-    alpha->resize(num_states, kLogZeroDouble);
-    beta->resize(num_states, kLogZeroDouble);
-
-    double tot_forward_prob = kLogZeroDouble;
-    (*alpha)[0] = 0.0;
-    // Propagate alphas forward.
+    std::vector<int32> offsets, ilabels, olabels, nextstates;
+    std::vector<float> weights, final_weights;
+    offsets.reserve(num_states + 1);
+    offsets.push_back(0);
     for (StateId s = 0; s < num_states; s++) {
-      double this_alpha = (*alpha)[s];
-      for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-           aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        double arc_like = -ConvertToCost(arc.weight);
-        (*alpha)[arc.nextstate] = LogAdd((*alpha)[arc.nextstate],
-                                         this_alpha + arc_like);
-      }
-      Weight f = lat.Final(s);
-      if (f != Weight::Zero()) {
-        double final_like = this_alpha - ConvertToCost(f);
-        tot_forward_prob = LogAdd(tot_forward_prob, final_like);
+      for (ArcIterator<VectorFst<LogArc> > aiter(lat, s); !aiter.Done(); aiter.Next()) {
+        const LogArc &arc = aiter.Value();
+        ilabels.push_back(arc.ilabel);
+        olabels.push_back(arc.olabel);
+        nextstates.push_back(arc.nextstate);
+        weights.push_back(arc.weight.Value());
       }
+      offsets.push_back(ilabels.size());
+      final_weights.push_back(lat.Final(s).Value());
     }
-    for (StateId s = num_states-1; s >= 0; s--) { // it's guaranteed signed.
-      double this_beta = -ConvertToCost(lat.Final(s));
-      for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-           aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        double arc_like = -ConvertToCost(arc.weight),
-                arc_beta = (*beta)[arc.nextstate] + arc_like;
-        this_beta = LogAdd(this_beta, arc_beta);
+
+    FlatLatticeWriter writer(buffer);
+    writer.AppendHeader(kFlatWordsPost, num_states, ilabels.size(),
+                        num_states > 0 ? lat.Start() : -1, 0, tot_lik);
+    writer.Append(offsets);
+    writer.Append(ilabels);
+    writer.Append(olabels);
+    writer.Append(nextstates);
+    writer.Append(weights);
+    writer.Append(final_weights);
+  }
+
+  void CompactLatticeToFlatLattice(const CompactLattice &clat, std::vector<char> *buffer) {
+    using namespace fst;
+    typedef CompactLatticeArc::StateId StateId;
+    const float inf = std::numeric_limits<float>::infinity();
+
+    StateId num_states = clat.NumStates();
+    std::vector<int32> offsets, ilabels, olabels, nextstates,
+        ali_offsets, final_ali_offsets, alignment, final_alignment;
+    std::vector<float> graph_weights, ac_weights, final_graph_weights, final_ac_weights;
+    offsets.push_back(0);
+    ali_offsets.push_back(0);
+    final_ali_offsets.push_back(0);
+    for (StateId s = 0; s < num_states; s++) {
+      for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        ilabels.push_back(arc.ilabel);
+        olabels.push_back(arc.olabel);
+        nextstates.push_back(arc.nextstate);
+        graph_weights.push_back(arc.weight.Weight().Value1());
+        ac_weights.push_back(arc.weight.Weight().Value2());
+        const std::vector<int32> &ali = arc.weight.String();
+        alignment.insert(alignment.end(), ali.begin(), ali.end());
+        ali_offsets.push_back(alignment.size());
       }
-      (*beta)[s] = this_beta;
-    }
-    double tot_backward_prob = (*beta)[lat.Start()];
-    if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
-      KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
-      << ", while total backward probability = " << tot_backward_prob;
+      offsets.push_back(ilabels.size());
+
+      CompactLatticeWeight final_weight = clat.Final(s);
+      if (final_weight != CompactLatticeWeight::Zero()) {
+        final_graph_weights.push_back(final_weight.Weight().Value1());
+        final_ac_weights.push_back(final_weight.Weight().Value2());
+        const std::vector<int32> &ali = final_weight.String();
+        final_alignment.insert(final_alignment.end(), ali.begin(), ali.end());
+      } else {
+        final_graph_weights.push_back(inf);
+        final_ac_weights.push_back(inf);
+      }
+      final_ali_offsets.push_back(final_alignment.size());
     }
-    // Split the difference when returning... they should be the same.
-    return 0.5 * (tot_backward_prob + tot_forward_prob);
+    // Final alignments are stored after all the arc alignments.
+    for (size_t i = 0; i < final_ali_offsets.size(); i++)
+      final_ali_offsets[i] += alignment.size();
+    alignment.insert(alignment.end(), final_alignment.begin(), final_alignment.end());
+
+    FlatLatticeWriter writer(buffer);
+    writer.AppendHeader(kFlatCompactLattice, num_states, ilabels.size(),
+                        num_states > 0 ? clat.Start() : -1, alignment.size(), 0.0);
+    writer.Append(offsets);
+    writer.Append(ilabels);
+    writer.Append(olabels);
+    writer.Append(nextstates);
+    writer.Append(graph_weights);
+    writer.Append(final_graph_weights);
+    writer.Append(ac_weights);
+    writer.Append(final_ac_weights);
+    writer.Append(ali_offsets);
+    writer.Append(final_ali_offsets);
+    writer.Append(alignment);
   }
 
     const string GetDirectory(const string& file_name) {
@@ -43,44 +43,61 @@ namespace alex_asr {
     /// \addtogroup online_latgen_utils
     /// @{
 
-    // typedef double ComputeLatticeAlphasAndBetas<CompactLattice> ComputeCompactLatticeAlphasAndBetas;
-
-
     // Lattice lat has to have loglikelihoods on weights
     void MovePostToArcs(const std::vector<double> &alpha,
                         const std::vector<double> &beta,
                         fst::VectorFst<fst::LogArc> * lat);
 
 
+    struct WordsPostOptions {
+        // Arcs whose posterior is below exp(-beam) relative to the best path
+        // are pruned before the lattice is minimized. 0 disables pruning.
+        BaseFloat beam;
+        // Maximum number of arcs of the lattice; the beam is tightened until
+        // the lattice fits. 0 means no limit.
+        int32 max_arcs;
+
+        WordsPostOptions() : beam(0.0), max_arcs(0) { }
+    };
+
     // the input lattice has to have log-likelihood weights
-    double CompactLatticeToWordsPost(CompactLattice &lat, fst::VectorFst<fst::LogArc> *pst);
+    double CompactLatticeToWordsPost(const CompactLattice &lat, fst::VectorFst<fst::LogArc> *pst,
+                                     const WordsPostOptions &opts = WordsPostOptions());
+
+    // Flat lattice buffers: a lattice serialized into one contiguous block of
+    // native-endian 32 bit fields, so that it can be mapped without parsing
+    // (e.g. by numpy.frombuffer) or sent over a socket as is.
+    //
+    //   char    magic[4] = "ALAT"
+    //   int32   version = 1
+    //   int32   kind                (kFlatWordsPost or kFlatCompactLattice)
+    //   int32   num_states
+    //   int32   num_arcs
+    //   int32   start_state
+    //   int32   num_alignment       (total number of transition ids)
+    //   float   tot_lik             (total log-likelihood; 0 for kFlatCompactLattice)
+    //   int32   state_offsets[num_states + 1]  (arcs of state s: [offsets[s], offsets[s + 1]))
+    //   int32   ilabels[num_arcs]
+    //   int32   olabels[num_arcs]
+    //   int32   nextstates[num_arcs]
+    //   float   weights[num_arcs]           (-log posterior / graph cost)
+    //   float   final_weights[num_states]   (infinity for non-final states)
+    // kFlatCompactLattice only:
+    //   float   acoustic_weights[num_arcs]
+    //   float   final_acoustic_weights[num_states]
+    //   int32   alignment_offsets[num_arcs + 1]
+    //   int32   final_alignment_offsets[num_states + 1]
+    //   int32   alignment[num_alignment]   (arc alignments first, then final ones)
+    enum FlatLatticeKind { kFlatWordsPost = 0, kFlatCompactLattice = 1 };
+
+    void WordsPostToFlatLattice(const fst::VectorFst<fst::LogArc> &lat, double tot_lik,
+                                std::vector<char> *buffer);
+
+    void CompactLatticeToFlatLattice(const CompactLattice &clat, std::vector<char> *buffer);
 
     /// @} end of "addtogroup online_latgen_utils"
 
-    template<typename LatticeType>
-    static double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
-                                               vector<double> *alpha,
-                                               vector<double> *beta);
-
     const string GetDirectory(const string& file_name);
-
-    class local_cwd
-    {
-        string orig_dir_;
-
-    public:
-        local_cwd(string dir)
-        {
-            char temp[MAXPATHLEN];
-            orig_dir_ = ( getcwd(temp, MAXPATHLEN) ? std::string( temp ) : std::string("") );
-
-            chdir(dir.c_str());
-        }
-        ~local_cwd()
-        {
-            chdir(orig_dir_.c_str());
-        }
-    };
 } // namespace kaldi
 
 #endif // KALDI_DEC_WRAP_UTILS_H_
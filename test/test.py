@@ -11,8 +11,33 @@ def word_ids_to_str_hyp(decoder, word_ids):
     return" ".join(decoder.get_word(word_id).decode('utf8') for word_id in word_ids)
 
 
+class HypothesisPrinter(object):
+    """Prints the results pushed by the decoder as they change."""
+
+    def __init__(self, decoder):
+        self.decoder = decoder
+        self.word_ids = []
+        self.num_stable = 0
+        self.endpoint = False
+
+    def on_partial_result(self, word_ids):
+        self.word_ids = word_ids
+        print('Hypothesis: "%s" (speaker finished speaking: %s)' % (word_ids_to_str_hyp(self.decoder, word_ids), self.endpoint, ))
+
+    def on_stable_prefix(self, word_ids):
+        assert word_ids == self.word_ids[:len(word_ids)]
+        assert len(word_ids) >= self.num_stable
+        self.num_stable = len(word_ids)
+        print('Stable prefix: "%s"' % word_ids_to_str_hyp(self.decoder, word_ids))
+
+    def on_endpoint(self):
+        self.endpoint = True
+
+
 if __name__ == "__main__":
     decoder = Decoder(MODEL_PATH)
+    printer = HypothesisPrinter(decoder)
+    decoder.set_listener(printer)
 
     file_name = os.path.join(os.path.dirname(__file__), 'eleven.wav')
 
@@ -27,15 +52,11 @@ if __name__ == "__main__":
         decoder.accept_audio(frames)
         n_decoded += decoder.decode(8000)
 
-        if n_decoded > 0:
-            prob, word_ids = decoder.get_best_path()
-            # ivec = decoder.get_ivector()
-            print('Hypothesis: "%s" (speaker finished speaking: %s)' % (word_ids_to_str_hyp(decoder, word_ids), decoder.endpoint_detected(), ))
-
     decoder.input_finished()
-    print('Final hypothesis: "%s"' % word_ids_to_str_hyp(decoder, word_ids))
-
     decoder.finalize_decoding()
+    prob, word_ids = decoder.get_best_path()
+    assert printer.word_ids == word_ids
+    print('Final hypothesis: "%s"' % word_ids_to_str_hyp(decoder, word_ids))
 
     p, lat = decoder.get_lattice()
 
@@ -62,3 +83,10 @@ if __name__ == "__main__":
             print (word, time, duration, conf)
 
 
+
+    # An utterance without audio has no best path; computing its final
+    # result in the background must not abort.
+    decoder.reset()
+    decoder.input_finished()
+    result = decoder.finalize_decoding_async()
+    assert result.get_best_path()[1] == []
@@ -0,0 +1,72 @@
+from alex_asr import Decoder
+import wave
+import os
+import shutil
+import tempfile
+
+
+MODEL_PATH = os.path.join(os.path.dirname(__file__), "asr_model_digits")
+
+
+def make_checkpoint_model(tmp_dir):
+    """Copy of the digits model with checkpointing enabled (which needs --dither=0)."""
+    model_path = os.path.join(tmp_dir, "model")
+    shutil.copytree(MODEL_PATH, model_path)
+    with open(os.path.join(model_path, "alex_asr.conf"), "a") as f:
+        f.write("\n--enable_checkpoint=true\n")
+    with open(os.path.join(model_path, "mfcc.conf"), "a") as f:
+        f.write("\n--dither=0\n")
+    return model_path
+
+
+def read_chunks(chunk_size=4000):
+    data = wave.open(os.path.join(os.path.dirname(__file__), 'eleven.wav'))
+    chunks = []
+    while True:
+        frames = data.readframes(chunk_size)
+        if len(frames) == 0:
+            break
+        chunks.append(frames)
+    return chunks
+
+
+def feed(decoder, chunks):
+    for frames in chunks:
+        decoder.accept_audio(frames)
+        decoder.decode(8000)
+
+
+def results(decoder):
+    decoder.input_finished()
+    decoder.decode(8000)
+    decoder.finalize_decoding()
+    best_path = decoder.get_best_path()
+    alignment = decoder.get_time_alignment_with_word_confidence()
+    lik, lat = decoder.get_lattice()
+    return best_path, alignment, lik, len(list(lat.states))
+
+
+if __name__ == "__main__":
+    tmp_dir = tempfile.mkdtemp()
+    try:
+        model_path = make_checkpoint_model(tmp_dir)
+        chunks = read_chunks()
+        half = len(chunks) // 2
+
+        original = Decoder(model_path)
+        feed(original, chunks[:half])
+        checkpoint = original.checkpoint()
+
+        restored = Decoder(model_path)
+        restored.restore(checkpoint)
+        assert restored.get_best_path() == original.get_best_path()
+
+        feed(original, chunks[half:])
+        feed(restored, chunks[half:])
+        expected = results(original)
+        actual = results(restored)
+        assert actual == expected, "restored %s != original %s" % (actual, expected)
+
+        print('Checkpoint of %d bytes restored; results identical: %s' % (len(checkpoint), expected[0]))
+    finally:
+        shutil.rmtree(tmp_dir)